@@ -0,0 +1,84 @@
+// Measures moveTo/lineTo calls per second through the canvas wrapper.
+//
+// "id lookup" repeats what every wrapper call used to do before canvases were
+// registered in a handle table: decode the element id and search the DOM for
+// it on each call. "handle" and "recorded" go through the wrapper as it is.
+// "bulk" hands the same segments to strokeSegments() as one float array,
+// which also strokes them, so it measures a little more than the others.
+#include <stdio.h>  // sprintf
+#include <stdlib.h>  // malloc, free
+#include <emscripten/html5.h>  // emscripten_console_log, emscripten_get_now
+#include "canvas.h"  // HTMLCanvasElement, CanvasRenderingContext2D,
+                     // createCanvas, freeCanvas
+
+#define CALLS 200000
+
+
+void lookup_moveTo(char const *id, double x, double y) {
+	EM_ASM({
+		document.getElementById(UTF8ToString($0)).getContext('2d').moveTo($1, $2);
+	}, id, x, y);
+}
+
+
+void lookup_lineTo(char const *id, double x, double y) {
+	EM_ASM({
+		document.getElementById(UTF8ToString($0)).getContext('2d').lineTo($1, $2);
+	}, id, x, y);
+}
+
+
+void report(char const *name, double milliseconds) {
+	char message[64];
+	sprintf(message, "%-10s %12.0f calls/sec", name, CALLS / (milliseconds / 1000));
+	emscripten_console_log(message);
+}
+
+
+int main() {
+	HTMLCanvasElement *canvas = createCanvas("bench");
+	CanvasRenderingContext2D *context = canvas->getContext(canvas, "2d");
+	double start;
+
+	// Each run starts a new path so the previous one's segments are dropped.
+	context->beginPath(context);
+	start = emscripten_get_now();
+	for (int i = 0; i < CALLS; i += 2) {
+		lookup_moveTo("bench", i % 300, 0);
+		lookup_lineTo("bench", i % 300, 150);
+	}
+	report("id lookup", emscripten_get_now() - start);
+
+	context->beginPath(context);
+	start = emscripten_get_now();
+	for (int i = 0; i < CALLS; i += 2) {
+		context->moveTo(context, i % 300, 0);
+		context->lineTo(context, i % 300, 150);
+	}
+	report("handle", emscripten_get_now() - start);
+
+	context->beginPath(context);
+	start = emscripten_get_now();
+	context->beginRecording(context);
+	for (int i = 0; i < CALLS; i += 2) {
+		context->moveTo(context, i % 300, 0);
+		context->lineTo(context, i % 300, 150);
+	}
+	context->endRecording(context);
+	report("recorded", emscripten_get_now() - start);
+
+	float *segments = malloc(CALLS / 2 * 4 * sizeof(float));
+	for (int i = 0; i < CALLS; i += 2) {
+		float *segment = segments + i * 2;
+		segment[0] = segment[2] = i % 300;
+		segment[1] = 0;
+		segment[3] = 150;
+	}
+	start = emscripten_get_now();
+	context->strokeSegments(context, segments, CALLS / 2);
+	report("bulk", emscripten_get_now() - start);
+	free(segments);
+
+	freeCanvas(canvas);
+	return 0;
+}
@@ -0,0 +1,98 @@
+// Compares the array-of-structs integrate-and-bounce loop that animate()
+// used to run against particles_integrate() at 1k, 10k and 100k particles.
+//
+// Runs natively or under node:
+//     cc -O3 -march=native -I src bench/integrate.c src/particles.c -o integrate
+//     make build/bench_integrate.js && node build/bench_integrate.js
+#include <stdio.h>  // printf
+#include <stdlib.h>  // malloc, free, rand, srand, RAND_MAX
+#include <time.h>  // clock_gettime
+#include "particles.h"  // Particles, particles_*
+
+#define WIDTH 3840
+#define HEIGHT 2160
+#define MARGIN 3
+#define STEPS 1000
+
+struct Particle {
+	coord x;
+	coord y;
+	coord vx;
+	coord vy;
+};
+
+
+double now_ms() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+
+void integrate_aos(struct Particle *particles, int count) {
+	for (int i = 0; i < count; ++i) {
+		particles[i].x = particles[i].x + particles[i].vx;
+		particles[i].y = particles[i].y + particles[i].vy;
+		if (particles[i].x < MARGIN) {
+			particles[i].vx *= -1;
+			particles[i].x = MARGIN;
+		}
+		else if (particles[i].x > WIDTH - MARGIN) {
+			particles[i].vx *= -1;
+			particles[i].x = WIDTH - MARGIN;
+		}
+		if (particles[i].y < MARGIN) {
+			particles[i].vy *= -1;
+			particles[i].y = MARGIN;
+		}
+		else if (particles[i].y > HEIGHT - MARGIN) {
+			particles[i].vy *= -1;
+			particles[i].y = HEIGHT - MARGIN;
+		}
+	}
+}
+
+
+void run(int count) {
+	struct Particle *aos = malloc(count * sizeof(struct Particle));
+	struct Particles soa;
+	particles_init(&soa, count);
+	srand(count);
+	for (int i = 0; i < count; ++i) {
+		// Fast enough that plenty of particles hit an edge during the run.
+		aos[i].x = soa.x[i] = WIDTH * ((double)rand() / RAND_MAX);
+		aos[i].y = soa.y[i] = HEIGHT * ((double)rand() / RAND_MAX);
+		aos[i].vx = soa.vx[i] = 40 * ((double)rand() / RAND_MAX) - 20;
+		aos[i].vy = soa.vy[i] = 40 * ((double)rand() / RAND_MAX) - 20;
+	}
+
+	double start = now_ms();
+	for (int step = 0; step < STEPS; ++step) {
+		integrate_aos(aos, count);
+	}
+	double aos_ms = now_ms() - start;
+
+	start = now_ms();
+	for (int step = 0; step < STEPS; ++step) {
+		particles_integrate(&soa, WIDTH, HEIGHT, MARGIN);
+	}
+	double soa_ms = now_ms() - start;
+
+	int mismatches = 0;
+	for (int i = 0; i < count; ++i) {
+		mismatches += aos[i].x != soa.x[i] || aos[i].y != soa.y[i] || aos[i].vx != soa.vx[i] || aos[i].vy != soa.vy[i];
+	}
+	printf("%7d particles: AoS %8.3f ns/particle  SoA %8.3f ns/particle  %5.2fx  %d mismatches\n",
+	       count, aos_ms * 1e6 / STEPS / count, soa_ms * 1e6 / STEPS / count, aos_ms / soa_ms, mismatches);
+
+	free(aos);
+	particles_free(&soa);
+}
+
+
+int main() {
+	run(1000);
+	run(10000);
+	run(100000);
+	return 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * Allocators that keep the heap out of the frame loop.
+ * @file arena.c
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+
+/** The smallest chunk an arena mallocs. */
+#define ARENA_MIN_CHUNK 4096
+#define ALIGNMENT _Alignof(max_align_t)
+
+struct ArenaChunk
+{
+    ArenaChunk *next;
+    size_t size;
+    max_align_t data[];
+};
+
+static size_t alignUp(size_t size)
+{
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+static ArenaChunk *newChunk(size_t size)
+{
+    ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + size);
+    if (chunk)
+    {
+        chunk->next = NULL;
+        chunk->size = size;
+    }
+    return chunk;
+}
+
+/* Begin: Arena */
+void arenaInit(Arena *arena, size_t capacity)
+{
+    arena->chunks = capacity ? newChunk(alignUp(capacity)) : NULL;
+    arena->used = 0;
+    arena->total = 0;
+}
+
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    size = alignUp(size);
+    ArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->size - arena->used < size)
+    {
+        size_t capacity = chunk ? chunk->size * 2 : ARENA_MIN_CHUNK;
+        chunk = newChunk(capacity > size ? capacity : size);
+        if (!chunk)
+            return NULL;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->used = 0;
+    }
+    void *memory = (char *)chunk->data + arena->used;
+    arena->used += size;
+    arena->total += size;
+    return memory;
+}
+
+void arenaReset(Arena *arena)
+{
+    if (arena->chunks && arena->chunks->next)
+    {
+        // One chunk for all of it, with half as much again to spare, so that a frame only a
+        // little bigger than this one doesn't chain on another.
+        size_t capacity = ARENA_MIN_CHUNK;
+        while (capacity < arena->total + arena->total / 2)
+            capacity *= 2;
+        arenaFree(arena);
+        arena->chunks = newChunk(capacity);
+    }
+    arena->used = 0;
+    arena->total = 0;
+}
+
+void arenaFree(Arena *arena)
+{
+    while (arena->chunks)
+    {
+        ArenaChunk *next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena->used = 0;
+    arena->total = 0;
+}
+/* End: Arena */
+
+/* Begin: ObjectPool */
+/** Objects are aligned like malloc's, and big enough to link given ones together. */
+static size_t slotSize(ObjectPool const *pool)
+{
+    return alignUp(pool->objectSize > sizeof(void *) ? pool->objectSize : sizeof(void *));
+}
+
+void *objectPoolTake(ObjectPool *pool)
+{
+    if (pool->given)
+    {
+        void *object = pool->given;
+        pool->given = *(void **)object;
+        return object;
+    }
+    if (!pool->unused)
+    {
+        void *block = malloc(alignUp(sizeof(void *)) + pool->objectsPerBlock * slotSize(pool));
+        if (!block)
+            return NULL;
+        *(void **)block = pool->blocks;
+        pool->blocks = block;
+        pool->unused = pool->objectsPerBlock;
+    }
+    return (char *)pool->blocks + alignUp(sizeof(void *)) + (pool->objectsPerBlock - pool->unused--) * slotSize(pool);
+}
+
+void objectPoolGive(ObjectPool *pool, void *object)
+{
+    if (!object)
+        return;
+    *(void **)object = pool->given;
+    pool->given = object;
+}
+
+void objectPoolFree(ObjectPool *pool)
+{
+    while (pool->blocks)
+    {
+        void *next = *(void **)pool->blocks;
+        free(pool->blocks);
+        pool->blocks = next;
+    }
+    pool->unused = 0;
+    pool->given = NULL;
+}
+/* End: ObjectPool */
+
+#ifdef COUNT_HEAP_CALLS
+#include <stdatomic.h>
+
+static atomic_long heapCalls;
+
+/* With -Wl,--wrap=malloc, the program's calls to malloc() land in __wrap_malloc(), and
+ * __real_malloc() is the C library's. Likewise for the other three. */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+void __real_free(void *memory);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&heapCalls, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+void *__wrap_calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&heapCalls, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+void *__wrap_realloc(void *memory, size_t size)
+{
+    atomic_fetch_add_explicit(&heapCalls, 1, memory_order_relaxed);
+    return __real_realloc(memory, size);
+}
+void __wrap_free(void *memory)
+{
+    if (memory) // free(NULL) doesn't touch the heap
+        atomic_fetch_add_explicit(&heapCalls, 1, memory_order_relaxed);
+    __real_free(memory);
+}
+
+long heapCallCount()
+{
+    return atomic_load_explicit(&heapCalls, memory_order_relaxed);
+}
+#else
+long heapCallCount()
+{
+    return -1;
+}
+#endif
@@ -0,0 +1,84 @@
+/**
+ * Allocators that keep the heap out of the frame loop. An Arena hands out memory for buffers
+ * that only live until the end of a frame, or of a simulation step, by bumping a pointer, and
+ * takes all of it back at once with arenaReset(). An ObjectPool hands out objects of one size,
+ * such as the canvas wrappers, from blocks it keeps, and takes them back for reuse. Both only
+ * call malloc when they run out of room, so once the program has warmed up, its frames make
+ * no heap calls at all, which heapCallCount() can confirm.
+ *
+ * Neither is thread-safe: each belongs to the one thread that uses it.
+ * @file arena.h
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+/**
+ * A bump allocator. When a frame needs more than the arena's chunk holds, more chunks are
+ * chained on, and the next arenaReset() swaps them all for one chunk with room to spare, so
+ * the arena soon settles at a size that fits every frame in one chunk.
+ */
+typedef struct Arena
+{
+    /** The newest chunk first; memory is handed out from its end. */
+    ArenaChunk *chunks;
+    /** Bytes handed out from the newest chunk, and from every chunk since the last reset. */
+    size_t used;
+    size_t total;
+} Arena;
+
+/** Starts the arena with one chunk of at least capacity bytes, or none if capacity is 0. */
+void arenaInit(Arena *arena, size_t capacity);
+
+/**
+ * Returns size bytes, aligned for any type, that stay valid until the next arenaReset(). The
+ * memory is not cleared. Returns NULL if the heap has run out.
+ */
+void *arenaAlloc(Arena *arena, size_t size);
+
+/** Takes back everything handed out since the last reset. */
+void arenaReset(Arena *arena);
+
+/** Frees every chunk. The arena can be used again afterwards, starting empty. */
+void arenaFree(Arena *arena);
+
+/**
+ * Objects of one size, allocated a block at a time. Taking an object reuses the last one
+ * given back, if any; otherwise it comes from the newest block, and a new block is only
+ * malloc'd when that one is used up. Blocks are never freed until objectPoolFree().
+ */
+typedef struct ObjectPool
+{
+    size_t objectSize;
+    int objectsPerBlock;
+    /** Blocks, newest first, each starting with a pointer to the next. */
+    void *blocks;
+    /** Objects of the newest block not yet handed out. */
+    int unused;
+    /** Objects given back, each starting with a pointer to the next. */
+    void *given;
+} ObjectPool;
+
+/** A static initializer for a pool of objects of the given type, such as HTMLWindow. */
+#define OBJECT_POOL_INITIALIZER(type, objectsPerBlock) {sizeof(type), (objectsPerBlock), NULL, 0, NULL}
+
+/** Returns an uninitialized object, or NULL if the heap has run out. */
+void *objectPoolTake(ObjectPool *pool);
+
+/** Gives an object taken from the pool back to it. Does nothing given NULL. */
+void objectPoolGive(ObjectPool *pool, void *object);
+
+/** Frees every block, including the objects still taken. */
+void objectPoolFree(ObjectPool *pool);
+
+/**
+ * Returns how many times the program has called malloc, calloc, realloc or free, from any
+ * thread, or -1 if it can't tell. It can only tell when it's built with COUNT_HEAP_CALLS and
+ * linked with -Wl,--wrap for each of the four, as the Makefile's check-heap target does.
+ */
+long heapCallCount();
+
+#endif
@@ -8,37 +8,535 @@
  */
 
 #include "canvas.h"
+#include "canvas_stats.h"
+#include "arena.h"
+#include <stdarg.h>
+#include <math.h>
+
+#ifdef CANVAS_STATS
+#define COUNT_CROSSING(ctx) countCrossing(ctx)
+#define COUNT_ELIDED(ctx) countElided(ctx)
+#else
+#define COUNT_CROSSING(ctx) ((void)0)
+#define COUNT_ELIDED(ctx) ((void)0)
+#endif
 
 static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char const *contextType);
 
+/** The wrappers come from pools, so making and freeing canvases doesn't churn the heap. */
+static ObjectPool canvasPool = OBJECT_POOL_INITIALIZER(HTMLCanvasElement, 4);
+static ObjectPool contextPool = OBJECT_POOL_INITIALIZER(CanvasRenderingContext2D, 4);
+
+/**
+ * Opcodes for the recorded command buffer. The values are mirrored by the switch statement
+ * in flushCommands(), so they must not be renumbered without updating it as well.
+ */
+enum CanvasOpcode
+{
+    CANVAS_OP_CLEAR_RECT = 0,
+    CANVAS_OP_FILL_RECT = 1,
+    CANVAS_OP_STROKE_RECT = 2,
+    CANVAS_OP_FILL_TEXT = 3,
+    CANVAS_OP_STROKE_TEXT = 4,
+    CANVAS_OP_SET_LINE_WIDTH = 5,
+    CANVAS_OP_SET_LINE_CAP = 6,
+    CANVAS_OP_SET_LINE_JOIN = 7,
+    CANVAS_OP_SET_FONT = 8,
+    CANVAS_OP_SET_TEXT_ALIGN = 9,
+    CANVAS_OP_SET_FILL_STYLE = 10,
+    CANVAS_OP_SET_STROKE_STYLE = 11,
+    CANVAS_OP_BEGIN_PATH = 12,
+    CANVAS_OP_CLOSE_PATH = 13,
+    CANVAS_OP_MOVE_TO = 14,
+    CANVAS_OP_LINE_TO = 15,
+    CANVAS_OP_BEZIER_CURVE_TO = 16,
+    CANVAS_OP_QUADRATIC_CURVE_TO = 17,
+    CANVAS_OP_ARC = 18,
+    CANVAS_OP_ARC_TO = 19,
+    CANVAS_OP_ELLIPSE = 20,
+    CANVAS_OP_RECT = 21,
+    CANVAS_OP_FILL = 22,
+    CANVAS_OP_STROKE = 23,
+    CANVAS_OP_CLIP = 24,
+    CANVAS_OP_ROTATE = 25,
+    CANVAS_OP_SCALE = 26,
+    CANVAS_OP_TRANSLATE = 27,
+    CANVAS_OP_TRANSFORM = 28,
+    CANVAS_OP_SET_TRANSFORM = 29,
+    CANVAS_OP_RESET_TRANSFORM = 30,
+    CANVAS_OP_SET_GLOBAL_ALPHA = 31,
+    CANVAS_OP_SET_GLOBAL_COMPOSITE_OPERATION = 32,
+    CANVAS_OP_SAVE = 33,
+    CANVAS_OP_RESTORE = 34,
+    CANVAS_OP_DRAW_IMAGE = 35,
+    CANVAS_OP_STROKE_SEGMENTS = 36,
+    CANVAS_OP_FILL_CIRCLES = 37
+};
+
+/* Begin: command buffer helpers */
+static uint32_t *reserveCommandWords(CanvasRenderingContext2D *that, size_t count)
+{
+    if (that->privado.commands.length + count > that->privado.commands.capacity)
+    {
+        size_t capacity = that->privado.commands.capacity ? that->privado.commands.capacity : 1024;
+        while (capacity < that->privado.commands.length + count)
+            capacity *= 2;
+        that->privado.commands.words = (uint32_t *)realloc(that->privado.commands.words, capacity * sizeof(uint32_t));
+        that->privado.commands.capacity = capacity;
+    }
+    uint32_t *words = that->privado.commands.words + that->privado.commands.length;
+    that->privado.commands.length += count;
+    return words;
+}
+/**
+ * Appends one command to the buffer. The layout is the opcode word, followed by the string
+ * argument (if any) as a word count and its NUL-terminated bytes padded to a word boundary,
+ * followed by argc float32 arguments. Every variadic argument must be a double.
+ */
+static void recordCommand(CanvasRenderingContext2D *that, enum CanvasOpcode opcode, char const *string, int argc, ...)
+{
+    *reserveCommandWords(that, 1) = opcode;
+    if (string)
+    {
+        size_t bytes = strlen(string) + 1;
+        size_t count = (bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+        uint32_t *words = reserveCommandWords(that, count + 1);
+        words[0] = (uint32_t)count;
+        memcpy(words + 1, string, bytes);
+    }
+    float *args = (float *)reserveCommandWords(that, argc);
+    va_list list;
+    va_start(list, argc);
+    for (int i = 0; i < argc; ++i)
+        args[i] = (float)va_arg(list, double);
+    va_end(list);
+}
+/**
+ * Appends a command whose argument is an array: the opcode word, the number of elements, then
+ * count * stride float32 values copied from values.
+ */
+static void recordFloats(CanvasRenderingContext2D *that, enum CanvasOpcode opcode, float const *values, int count, int stride)
+{
+    uint32_t *words = reserveCommandWords(that, 2 + (size_t)count * stride);
+    words[0] = opcode;
+    words[1] = (uint32_t)count;
+    memcpy(words + 2, values, (size_t)count * stride * sizeof(float));
+}
+/**
+ * Replays every recorded command against the context with a single crossing into JavaScript,
+ * then empties the buffer. Does nothing when the buffer is already empty.
+ */
+static void flushCommands(CanvasRenderingContext2D *that)
+{
+    if (!that->privado.commands.length)
+        return;
+    COUNT_CROSSING(that);
+    EM_ASM({
+        var ctx = Module['contexts'][$0];
+        var u = HEAPU32;
+        var f = HEAPF32;
+        var p = $1 >> 2;
+        var end = p + $2;
+        var text = function() {
+            var s = UTF8ToString((p + 1) << 2);
+            p += u[p] + 1;
+            return s;
+        };
+        // Separate statements: a comma outside of parentheses would end the
+        // macro's argument here.
+        var s;
+        var e;
+        while (p < end)
+        {
+            switch (u[p++])
+            {
+            case 0: ctx.clearRect(f[p], f[p + 1], f[p + 2], f[p + 3]); p += 4; break;
+            case 1: ctx.fillRect(f[p], f[p + 1], f[p + 2], f[p + 3]); p += 4; break;
+            case 2: ctx.strokeRect(f[p], f[p + 1], f[p + 2], f[p + 3]); p += 4; break;
+            case 3:
+                s = text();
+                if (f[p + 2] < 0) ctx.fillText(s, f[p], f[p + 1]);
+                else ctx.fillText(s, f[p], f[p + 1], f[p + 2]);
+                p += 3;
+                break;
+            case 4:
+                s = text();
+                if (f[p + 2] < 0) ctx.strokeText(s, f[p], f[p + 1]);
+                else ctx.strokeText(s, f[p], f[p + 1], f[p + 2]);
+                p += 3;
+                break;
+            case 5: ctx.lineWidth = f[p]; p += 1; break;
+            case 6: ctx.lineCap = text(); break;
+            case 7: ctx.lineJoin = text(); break;
+            case 8: ctx.font = text(); break;
+            case 9: ctx.textAlign = text(); break;
+            case 10: ctx.fillStyle = text(); break;
+            case 11: ctx.strokeStyle = text(); break;
+            case 12: ctx.beginPath(); break;
+            case 13: ctx.closePath(); break;
+            case 14: ctx.moveTo(f[p], f[p + 1]); p += 2; break;
+            case 15: ctx.lineTo(f[p], f[p + 1]); p += 2; break;
+            case 16: ctx.bezierCurveTo(f[p], f[p + 1], f[p + 2], f[p + 3], f[p + 4], f[p + 5]); p += 6; break;
+            case 17: ctx.quadraticCurveTo(f[p], f[p + 1], f[p + 2], f[p + 3]); p += 4; break;
+            case 18: ctx.arc(f[p], f[p + 1], f[p + 2], f[p + 3], f[p + 4]); p += 5; break;
+            case 19: ctx.arcTo(f[p], f[p + 1], f[p + 2], f[p + 3], f[p + 4]); p += 5; break;
+            case 20: ctx.ellipse(f[p], f[p + 1], f[p + 2], f[p + 3], f[p + 4], f[p + 5], f[p + 6]); p += 7; break;
+            case 21: ctx.rect(f[p], f[p + 1], f[p + 2], f[p + 3]); p += 4; break;
+            case 22: ctx.fill(); break;
+            case 23: ctx.stroke(); break;
+            case 24: ctx.clip(); break;
+            case 25: ctx.rotate(f[p]); p += 1; break;
+            case 26: ctx.scale(f[p], f[p + 1]); p += 2; break;
+            case 27: ctx.translate(f[p], f[p + 1]); p += 2; break;
+            case 28: ctx.transform(f[p], f[p + 1], f[p + 2], f[p + 3], f[p + 4], f[p + 5]); p += 6; break;
+            case 29: ctx.setTransform(f[p], f[p + 1], f[p + 2], f[p + 3], f[p + 4], f[p + 5]); p += 6; break;
+            case 30: ctx.resetTransform(); break;
+            case 31: ctx.globalAlpha = f[p]; p += 1; break;
+            case 32: ctx.globalCompositeOperation = text(); break;
+            case 33: ctx.save(); break;
+            case 34: ctx.restore(); break;
+            case 35:
+                ctx.drawImage(Module['canvases'][f[p]], f[p + 1], f[p + 2], f[p + 3], f[p + 4], f[p + 5], f[p + 6], f[p + 7], f[p + 8]);
+                p += 9;
+                break;
+            case 36:
+                e = p + 1 + 4 * u[p];
+                ctx.beginPath();
+                for (p += 1; p < e; p += 4)
+                {
+                    ctx.moveTo(f[p], f[p + 1]);
+                    ctx.lineTo(f[p + 2], f[p + 3]);
+                }
+                ctx.stroke();
+                break;
+            case 37:
+                e = p + 1 + 3 * u[p];
+                ctx.beginPath();
+                for (p += 1; p < e; p += 3)
+                {
+                    ctx.moveTo(f[p] + f[p + 2], f[p + 1]);
+                    ctx.arc(f[p], f[p + 1], f[p + 2], 0, 2 * Math.PI);
+                }
+                ctx.fill();
+                break;
+            }
+        }
+    },
+           that->privado.canvas->privado.handle, that->privado.commands.words, that->privado.commands.length);
+    that->privado.commands.length = 0;
+}
+/* End: command buffer helpers */
+
+/* Begin: state mirror helpers */
+/** Slots in a context's style cache, which is emptied when this many are taken. */
+#define STYLE_CACHE_SLOTS 512
+#define STYLE_CACHE_LIMIT 384
+
+/** Strings are only interchangeable between properties of the same kind. */
+enum StyleKind
+{
+    STYLE_COLOR,
+    STYLE_FONT
+};
+/**
+ * A color or font string the context has been given, and the string JavaScript reads back
+ * after setting it, or NULL if JavaScript ignores it. Often value is text itself.
+ */
+struct CanvasStyleEntry
+{
+    char *text;
+    char *value;
+    enum StyleKind kind;
+};
+/** A hash table of every color and font string the context has been given. */
+struct CanvasStyleCache
+{
+    struct CanvasStyleEntry entries[STYLE_CACHE_SLOTS];
+    int count;
+};
+
+static char const *const lineCaps[] = {"butt", "round", "square", NULL};
+static char const *const lineJoins[] = {"miter", "round", "bevel", NULL};
+static char const *const textAligns[] = {"start", "end", "left", "right", "center", NULL};
+static char const *const compositeOperations[] = {
+    "source-over", "source-in", "source-out", "source-atop",
+    "destination-over", "destination-in", "destination-out", "destination-atop",
+    "lighter", "copy", "xor", "multiply", "screen", "overlay", "darken", "lighten",
+    "color-dodge", "color-burn", "hard-light", "soft-light", "difference", "exclusion",
+    "hue", "saturation", "color", "luminosity", NULL};
+
+/** Returns the keyword equal to value, which the setters remember, or NULL if there's none. */
+static char const *findKeyword(char const *const *keywords, char const *value)
+{
+    for (; *keywords; ++keywords)
+        if (strcmp(*keywords, value) == 0)
+            return *keywords;
+    return NULL;
+}
+/** Returns the slot holding text, or the empty slot it would go into. */
+static struct CanvasStyleEntry *findStyle(struct CanvasStyleCache *cache, enum StyleKind kind, char const *text)
+{
+    uint32_t hash = 2166136261u ^ kind; // FNV-1a
+    for (char const *c = text; *c; ++c)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    for (uint32_t slot = hash % STYLE_CACHE_SLOTS;; slot = (slot + 1) % STYLE_CACHE_SLOTS)
+    {
+        struct CanvasStyleEntry *entry = &cache->entries[slot];
+        if (!entry->text || (entry->kind == kind && strcmp(entry->text, text) == 0))
+            return entry;
+    }
+}
+static void freeStyles(struct CanvasStyleCache *cache)
+{
+    for (int slot = 0; slot < STYLE_CACHE_SLOTS; ++slot)
+    {
+        struct CanvasStyleEntry *entry = &cache->entries[slot];
+        if (entry->value != entry->text)
+            free(entry->value);
+        free(entry->text);
+        entry->text = entry->value = NULL;
+    }
+    cache->count = 0;
+}
+/**
+ * Makes room for one more string in the cache, emptying it if it's full. The states that
+ * pointed into it, current and saved, forget those strings.
+ */
+static void reserveStyle(CanvasRenderingContext2D *that)
+{
+    if (that->privado.styles->count < STYLE_CACHE_LIMIT)
+        return;
+    freeStyles(that->privado.styles);
+    for (int i = -1; i < that->privado.stackCount; ++i)
+    {
+        CanvasState *state = i < 0 ? &that->privado.state : &that->privado.stack[i];
+        state->fillStyle = NULL;
+        state->strokeStyle = NULL;
+        state->font = NULL;
+    }
+}
+/** Forgets the whole state, for when it can't be worked out from C. */
+static void forgetState(CanvasState *state)
+{
+    state->lineWidth = NAN;
+    state->globalAlpha = NAN;
+    state->transformKnown = 0;
+    state->fillStyle = NULL;
+    state->strokeStyle = NULL;
+    state->font = NULL;
+    state->textAlign = NULL;
+    state->lineCap = NULL;
+    state->lineJoin = NULL;
+    state->globalCompositeOperation = NULL;
+}
+/** Sets the transform the mirror knows to be current. */
+static void knowTransform(CanvasState *state, double a, double b, double c, double d, double e, double f)
+{
+    double transform[6] = {a, b, c, d, e, f};
+    memcpy(state->transform, transform, sizeof(transform));
+    state->transformKnown = 1;
+}
+/** Remembers the defaults, which setting the canvas' size resets the context to. */
+static void resetState(CanvasRenderingContext2D *that)
+{
+    CanvasState *state = &that->privado.state;
+    state->lineWidth = 1;
+    state->globalAlpha = 1;
+    knowTransform(state, 1, 0, 0, 1, 0, 0);
+    state->fillStyle = "#000000";
+    state->strokeStyle = "#000000";
+    state->font = "10px sans-serif";
+    state->textAlign = textAligns[0];
+    state->lineCap = lineCaps[0];
+    state->lineJoin = lineJoins[0];
+    state->globalCompositeOperation = compositeOperations[0];
+    that->privado.stackCount = 0;
+    that->privado.pathEmpty = 1;
+}
+/** Returns the number JavaScript ends up with when it's given value, which recording rounds. */
+static double forwardedNumber(CanvasRenderingContext2D *that, double value)
+{
+    return that->privado.commands.recording ? (double)(float)value : value;
+}
+/** Whether every argument is finite: JavaScript ignores path and transform calls otherwise. */
+static int allFinite(int count, double const *values)
+{
+    for (int i = 0; i < count; ++i)
+        if (!isfinite(values[i]))
+            return 0;
+    return 1;
+}
+/** Sets a string property in JavaScript, or records it, without looking at the mirror. */
+static void forwardStringProperty(CanvasRenderingContext2D *that, enum CanvasOpcode opcode, char const *property, char const *value)
+{
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, opcode, value, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
+    EM_ASM({
+        Module['contexts'][$0][UTF8ToString($1)] = UTF8ToString($2);
+    },
+           that->privado.canvas->privado.handle, property, value);
+}
+static void setKeywordProperty(CanvasRenderingContext2D *that, enum CanvasOpcode opcode, char const *property,
+                               char const **mirror, char const *const *keywords, char const *value)
+{
+    char const *keyword = findKeyword(keywords, value);
+    if (!keyword || keyword == *mirror) // JavaScript ignores it, or it's already set
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    *mirror = keyword;
+    forwardStringProperty(that, opcode, property, keyword);
+}
+/**
+ * Sets a color or font property. The first time the context sees a string, JavaScript sets
+ * it twice, over two different values, and reads it back each time: if it reads back the
+ * same both times, it took the string, and the property is already set.
+ */
+static void setStyleProperty(CanvasRenderingContext2D *that, enum CanvasOpcode opcode, char const *property,
+                             char const **mirror, enum StyleKind kind, char const *value)
+{
+    if (*mirror && strcmp(*mirror, value) == 0)
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    struct CanvasStyleEntry *entry = findStyle(that->privado.styles, kind, value);
+    if (!entry->text)
+    {
+        reserveStyle(that);
+        entry = findStyle(that->privado.styles, kind, value);
+        size_t bytes = strlen(value) + 1;
+        entry->text = (char *)malloc(bytes);
+        memcpy(entry->text, value, bytes);
+        entry->kind = kind;
+        ++that->privado.styles->count;
+        flushCommands(that); // the previous value is put back if the string is ignored
+        COUNT_CROSSING(that);
+        entry->value = (char *)EM_ASM_INT({
+            var ctx = Module['contexts'][$0];
+            var property = UTF8ToString($1);
+            var value = UTF8ToString($2);
+            var probes = ($3 ? ['1px serif', '2px serif'] : ['#010203', '#040506']);
+            var previous = ctx[property];
+            ctx[property] = probes[0];
+            ctx[property] = value;
+            var string = ctx[property];
+            ctx[property] = probes[1];
+            ctx[property] = value;
+            if (ctx[property] != string)
+            {
+                ctx[property] = previous;
+                return 0;
+            }
+            var strlen = lengthBytesUTF8(string) + 1;
+            var strptr = _malloc(strlen);
+            stringToUTF8(string, strptr, strlen);
+            return strptr;
+        },
+                                          that->privado.canvas->privado.handle, property, value, kind == STYLE_FONT);
+        if (entry->value && strcmp(entry->value, entry->text) == 0)
+        {
+            free(entry->value);
+            entry->value = entry->text;
+        }
+        if (entry->value)
+            *mirror = entry->value;
+        return;
+    }
+    if (!entry->value || (*mirror && strcmp(*mirror, entry->value) == 0)) // ignored, or the same value spelled differently
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    *mirror = entry->value;
+    forwardStringProperty(that, opcode, property, entry->value);
+}
+/** Asks JavaScript for a keyword property that isn't known, for when the mirror can't say. */
+static char const *getKeywordProperty(CanvasRenderingContext2D *that, char const *property, char const **mirror, char const *const *keywords)
+{
+    if (*mirror)
+        return *mirror;
+    char buffer[32];
+    flushCommands(that);
+    COUNT_CROSSING(that);
+    EM_ASM({
+        stringToUTF8(Module['contexts'][$0][UTF8ToString($1)], $2, $3);
+    },
+           that->privado.canvas->privado.handle, property, buffer, sizeof(buffer));
+    *mirror = findKeyword(keywords, buffer);
+    return *mirror ? *mirror : keywords[0];
+}
+/** Asks JavaScript for a color or font property that isn't known and caches the answer. */
+static char const *getStyleProperty(CanvasRenderingContext2D *that, char const *property, char const **mirror, enum StyleKind kind)
+{
+    if (*mirror)
+        return *mirror;
+    flushCommands(that);
+    COUNT_CROSSING(that);
+    char *string = (char *)EM_ASM_INT({
+        var string = Module['contexts'][$0][UTF8ToString($1)];
+        var strlen = lengthBytesUTF8(string) + 1;
+        var strptr = _malloc(strlen);
+        stringToUTF8(string, strptr, strlen);
+        return strptr;
+    },
+                                      that->privado.canvas->privado.handle, property);
+    reserveStyle(that);
+    struct CanvasStyleEntry *entry = findStyle(that->privado.styles, kind, string);
+    if (entry->text)
+        free(string); // JavaScript reads back what it reads back, so entry->value is the string
+    else
+    {
+        entry->text = entry->value = string;
+        entry->kind = kind;
+        ++that->privado.styles->count;
+    }
+    *mirror = entry->value;
+    return *mirror;
+}
+/* End: state mirror helpers */
+
 /* Begin: HTMLCanvasElement static methods */
 static int canvas_getWidth(HTMLCanvasElement *that)
 {
-    return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).width;
-    },
-                      that->privado.id);
+    return that->privado.width;
 }
 static int canvas_getHeight(HTMLCanvasElement *that)
 {
-    return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).height;
-    },
-                      that->privado.id);
+    return that->privado.height;
 }
 static void canvas_setWidth(HTMLCanvasElement *that, int width)
 {
+    if (that->privado.ctx)
+    {
+        flushCommands(that->privado.ctx); // resizing resets the context, so pending commands go first
+        resetState(that->privado.ctx);
+    }
+    COUNT_CROSSING(that->privado.ctx);
+    that->privado.width = width >= 0 ? width : 300;
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).width = $1;
+        Module['canvases'][$0].width = $1;
     },
-           that->privado.id, width);
+           that->privado.handle, that->privado.width);
 }
 static void canvas_setHeight(HTMLCanvasElement *that, int height)
 {
+    if (that->privado.ctx)
+    {
+        flushCommands(that->privado.ctx); // resizing resets the context, so pending commands go first
+        resetState(that->privado.ctx);
+    }
+    COUNT_CROSSING(that->privado.ctx);
+    that->privado.height = height >= 0 ? height : 150;
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).height = $1;
+        Module['canvases'][$0].height = $1;
     },
-           that->privado.id, height);
+           that->privado.handle, that->privado.height);
 }
 static CanvasRenderingContext2D *canvas_getContext(HTMLCanvasElement *that, char const *contextType)
 {
@@ -50,17 +548,64 @@ static CanvasRenderingContext2D *canvas_getContext(HTMLCanvasElement *that, char
 
 HTMLCanvasElement *createCanvas(char const *id)
 {
-    EM_ASM(
+    HTMLCanvasElement *c = (HTMLCanvasElement *)objectPoolTake(&canvasPool);
+    /* Begin: set pseudo-privado fields */
+    // the element is resolved once here; every later call indexes the handle table instead
+    c->privado.handle = EM_ASM_INT(
         {
-            if (!document.getElementById(UTF8ToString($0)))
-                document.body.appendChild(document.createElement("canvas")).setAttribute("id", UTF8ToString($0));
+            var id = UTF8ToString($0);
+            // a canvas transferred to this thread is kept by Emscripten's GL library
+            var transferred = typeof GL != 'undefined' && GL.offscreenCanvases && GL.offscreenCanvases[id];
+            var element = transferred ? transferred.offscreenCanvas : document.getElementById(id);
+            if (!element)
+            {
+                element = document.body.appendChild(document.createElement("canvas"));
+                element.setAttribute("id", id);
+            }
+            var canvases = Module['canvases'] = Module['canvases'] || [];
+            var handle = canvases.indexOf(element);
+            return handle < 0 ? canvases.push(element) - 1 : handle;
         },
         id);
-    HTMLCanvasElement *c = (HTMLCanvasElement *)malloc(sizeof(HTMLCanvasElement));
-    /* Begin: set pseudo-privado fields */
     c->privado.id = (char *)malloc(strlen(id) + 1);
     strcpy(c->privado.id, id);
     c->privado.ctx = NULL; // we'll lazy-load the context when it's asked for
+    c->privado.backend = NULL;
+    c->privado.width = EM_ASM_INT({
+        return Module['canvases'][$0].width;
+    },
+                                  c->privado.handle);
+    c->privado.height = EM_ASM_INT({
+        return Module['canvases'][$0].height;
+    },
+                                   c->privado.handle);
+    /* End: set pseudo-privado fields */
+    c->getWidth = canvas_getWidth;
+    c->getHeight = canvas_getHeight;
+    c->setHeight = canvas_setHeight;
+    c->setWidth = canvas_setWidth;
+    c->getContext = canvas_getContext;
+    return c;
+}
+
+HTMLCanvasElement *createOffscreenCanvas(int width, int height)
+{
+    HTMLCanvasElement *c = (HTMLCanvasElement *)objectPoolTake(&canvasPool);
+    /* Begin: set pseudo-privado fields */
+    c->privado.handle = EM_ASM_INT(
+        {
+            var element = typeof document != 'undefined' ? document.createElement("canvas") : new OffscreenCanvas($0, $1);
+            element.width = $0;
+            element.height = $1;
+            var canvases = Module['canvases'] = Module['canvases'] || [];
+            return canvases.push(element) - 1;
+        },
+        width, height);
+    c->privado.id = (char *)calloc(1, 1);
+    c->privado.ctx = NULL;
+    c->privado.backend = NULL;
+    c->privado.width = width;
+    c->privado.height = height;
     /* End: set pseudo-privado fields */
     c->getWidth = canvas_getWidth;
     c->getHeight = canvas_getHeight;
@@ -73,422 +618,716 @@ HTMLCanvasElement *createCanvas(char const *id)
 /* Begin: CanvasRenderingContext2D static methods */
 static void context2d_clearRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_CLEAR_RECT, NULL, 4, x, y, width, height);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').clearRect($1, $2, $3, $4);
+        Module['contexts'][$0].clearRect($1, $2, $3, $4);
     },
-           that->privado.canvas->privado.id, x, y, width, height);
+           that->privado.canvas->privado.handle, x, y, width, height);
 }
 static void context2d_fillRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_FILL_RECT, NULL, 4, x, y, width, height);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').fillRect($1, $2, $3, $4);
+        Module['contexts'][$0].fillRect($1, $2, $3, $4);
     },
-           that->privado.canvas->privado.id, x, y, width, height);
+           that->privado.canvas->privado.handle, x, y, width, height);
 }
 static void context2d_strokeRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_STROKE_RECT, NULL, 4, x, y, width, height);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').strokeRect($1, $2, $3, $4);
+        Module['contexts'][$0].strokeRect($1, $2, $3, $4);
     },
-           that->privado.canvas->privado.id, x, y, width, height);
+           that->privado.canvas->privado.handle, x, y, width, height);
 }
 static void context2d_fillText(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_FILL_TEXT, text, 3, x, y, maxWidth);
+        return;
+    }
     if (maxWidth < 0.0)
     {
+        COUNT_CROSSING(that);
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').fillText(UTF8ToString($1), $2, $3);
+            Module['contexts'][$0].fillText(UTF8ToString($1), $2, $3);
         },
-               that->privado.canvas->privado.id, text, x, y);
+               that->privado.canvas->privado.handle, text, x, y);
     }
     else
     {
+        COUNT_CROSSING(that);
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').fillText(UTF8ToString($1), $2, $3, $4);
+            Module['contexts'][$0].fillText(UTF8ToString($1), $2, $3, $4);
         },
-               that->privado.canvas->privado.id, text, x, y, maxWidth);
+               that->privado.canvas->privado.handle, text, x, y, maxWidth);
     }
 }
 static void context2d_strokeText(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_STROKE_TEXT, text, 3, x, y, maxWidth);
+        return;
+    }
     if (maxWidth < 0.0)
     {
+        COUNT_CROSSING(that);
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').strokeText(UTF8ToString($1), $2, $3);
+            Module['contexts'][$0].strokeText(UTF8ToString($1), $2, $3);
         },
-               that->privado.canvas->privado.id, text, x, y);
+               that->privado.canvas->privado.handle, text, x, y);
     }
     else
     {
+        COUNT_CROSSING(that);
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').strokeText(UTF8ToString($1), $2, $3, $4);
+            Module['contexts'][$0].strokeText(UTF8ToString($1), $2, $3, $4);
         },
-               that->privado.canvas->privado.id, text, x, y, maxWidth);
+               that->privado.canvas->privado.handle, text, x, y, maxWidth);
     }
 }
+static void context2d_drawImage(CanvasRenderingContext2D *that, HTMLCanvasElement *image, double sx, double sy, double sw, double sh, double dx, double dy, double dw, double dh)
+{
+    if (that->privado.commands.recording)
+    {
+        // the handle is small enough to be exact as a float32
+        recordCommand(that, CANVAS_OP_DRAW_IMAGE, NULL, 9, (double)image->privado.handle, sx, sy, sw, sh, dx, dy, dw, dh);
+        return;
+    }
+    COUNT_CROSSING(that);
+    EM_ASM({
+        Module['contexts'][$0].drawImage(Module['canvases'][$1], $2, $3, $4, $5, $6, $7, $8, $9);
+    },
+           that->privado.canvas->privado.handle, image->privado.handle, sx, sy, sw, sh, dx, dy, dw, dh);
+}
 static void context2d_setLineWidth(CanvasRenderingContext2D *that, double value)
 {
+    value = forwardedNumber(that, value);
+    if (!(value > 0) || isinf(value) || value == that->privado.state.lineWidth) // ignored, or already set
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    that->privado.state.lineWidth = value;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_SET_LINE_WIDTH, NULL, 1, value);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineWidth = ($1);
+        Module['contexts'][$0].lineWidth = ($1);
     },
-           that->privado.canvas->privado.id, value);
+           that->privado.canvas->privado.handle, value);
 }
 static double context2d_getLineWidth(CanvasRenderingContext2D *that)
 {
-    return EM_ASM_DOUBLE({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').lineWidth;
+    if (!isnan(that->privado.state.lineWidth))
+        return that->privado.state.lineWidth;
+    flushCommands(that);
+    COUNT_CROSSING(that);
+    that->privado.state.lineWidth = EM_ASM_DOUBLE({
+        return Module['contexts'][$0].lineWidth;
     },
-                         that->privado.canvas->privado.id);
+                                                  that->privado.canvas->privado.handle);
+    return that->privado.state.lineWidth;
 }
 static void context2d_setLineCap(CanvasRenderingContext2D *that, char const *type)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineCap = UTF8ToString($1);
-    },
-           that->privado.canvas->privado.id, type);
+    setKeywordProperty(that, CANVAS_OP_SET_LINE_CAP, "lineCap", &that->privado.state.lineCap, lineCaps, type);
 }
 static char const *context2d_getLineCap(CanvasRenderingContext2D *that)
 {
-    if (that->privado.lineCap)
-        free(that->privado.lineCap);
-    that->privado.lineCap = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').lineCap;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                               that->privado.canvas->privado.id);
-    return that->privado.lineCap;
+    return getKeywordProperty(that, "lineCap", &that->privado.state.lineCap, lineCaps);
 }
 static void context2d_setLineJoin(CanvasRenderingContext2D *that, char const *type)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineJoin = UTF8ToString($1);
-    },
-           that->privado.canvas->privado.id, type);
+    setKeywordProperty(that, CANVAS_OP_SET_LINE_JOIN, "lineJoin", &that->privado.state.lineJoin, lineJoins, type);
 }
 static char const *context2d_getLineJoin(CanvasRenderingContext2D *that)
 {
-    if (that->privado.lineJoin)
-        free(that->privado.lineJoin);
-    that->privado.lineJoin = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').lineJoin;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                that->privado.canvas->privado.id);
-    return that->privado.lineJoin;
+    return getKeywordProperty(that, "lineJoin", &that->privado.state.lineJoin, lineJoins);
 }
 static char const *context2d_getFont(CanvasRenderingContext2D *that)
 {
-    if (that->privado.font)
-        free(that->privado.font); // this field could be reused, but we won't just in case it changes from the JS side
-    that->privado.font = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').font;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                            that->privado.canvas->privado.id);
-    return that->privado.font;
+    return getStyleProperty(that, "font", &that->privado.state.font, STYLE_FONT);
 }
 static void context2d_setFont(CanvasRenderingContext2D *that, char const *value)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').font = UTF8ToString($1);
-    },
-           that->privado.canvas->privado.id, value);
+    setStyleProperty(that, CANVAS_OP_SET_FONT, "font", &that->privado.state.font, STYLE_FONT, value);
 }
 static char const *context2d_getTextAlign(CanvasRenderingContext2D *that)
 {
-    if (that->privado.textAlign)
-        free(that->privado.textAlign);
-    that->privado.textAlign = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').textAlign;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                 that->privado.canvas->privado.id);
-    return that->privado.textAlign;
+    return getKeywordProperty(that, "textAlign", &that->privado.state.textAlign, textAligns);
 }
 static void context2d_setTextAlign(CanvasRenderingContext2D *that, char const *value)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').textAlign = UTF8ToString($1);
-    },
-           that->privado.canvas->privado.id, value);
+    setKeywordProperty(that, CANVAS_OP_SET_TEXT_ALIGN, "textAlign", &that->privado.state.textAlign, textAligns, value);
 }
 static char const *context2d_getFillStyle(CanvasRenderingContext2D *that)
 {
-    if (that->privado.fillStyle)
-        free(that->privado.fillStyle);
-    that->privado.fillStyle = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').fillStyle;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                 that->privado.canvas->privado.id);
-    return that->privado.fillStyle;
+    return getStyleProperty(that, "fillStyle", &that->privado.state.fillStyle, STYLE_COLOR);
 }
 static void context2d_setFillStyle(CanvasRenderingContext2D *that, char const *value)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').fillStyle = UTF8ToString($1);
-    },
-           that->privado.canvas->privado.id, value);
+    setStyleProperty(that, CANVAS_OP_SET_FILL_STYLE, "fillStyle", &that->privado.state.fillStyle, STYLE_COLOR, value);
 }
 static char const *context2d_getStrokeStyle(CanvasRenderingContext2D *that)
 {
-    if (that->privado.strokeStyle)
-        free(that->privado.strokeStyle);
-    that->privado.strokeStyle = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').strokeStyle;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                   that->privado.canvas->privado.id);
-    return that->privado.strokeStyle;
+    return getStyleProperty(that, "strokeStyle", &that->privado.state.strokeStyle, STYLE_COLOR);
 }
 static void context2d_setStrokeStyle(CanvasRenderingContext2D *that, char const *value)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').strokeStyle = UTF8ToString($1);
-    },
-           that->privado.canvas->privado.id, value);
+    setStyleProperty(that, CANVAS_OP_SET_STROKE_STYLE, "strokeStyle", &that->privado.state.strokeStyle, STYLE_COLOR, value);
 }
 static void context2d_beginPath(CanvasRenderingContext2D *that)
 {
+    if (that->privado.pathEmpty)
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    that->privado.pathEmpty = 1;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_BEGIN_PATH, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').beginPath();
+        Module['contexts'][$0].beginPath();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
 }
 static void context2d_closePath(CanvasRenderingContext2D *that)
 {
+    if (that->privado.pathEmpty) // there's no subpath to close
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_CLOSE_PATH, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').closePath();
+        Module['contexts'][$0].closePath();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
 }
 static void context2d_moveTo(CanvasRenderingContext2D *that, double x, double y)
 {
+    if (allFinite(2, (double[]){x, y}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_MOVE_TO, NULL, 2, x, y);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').moveTo($1, $2);
+        Module['contexts'][$0].moveTo($1, $2);
     },
-           that->privado.canvas->privado.id, x, y);
+           that->privado.canvas->privado.handle, x, y);
 }
 static void context2d_lineTo(CanvasRenderingContext2D *that, double x, double y)
 {
+    if (allFinite(2, (double[]){x, y}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_LINE_TO, NULL, 2, x, y);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineTo($1, $2);
+        Module['contexts'][$0].lineTo($1, $2);
     },
-           that->privado.canvas->privado.id, x, y);
+           that->privado.canvas->privado.handle, x, y);
 }
 static void context2d_bezierCurveTo(CanvasRenderingContext2D *that, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
 {
+    if (allFinite(6, (double[]){cp1x, cp1y, cp2x, cp2y, x, y}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_BEZIER_CURVE_TO, NULL, 6, cp1x, cp1y, cp2x, cp2y, x, y);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').bezierCurveTo($1, $2, $3, $4, $5, $6);
+        Module['contexts'][$0].bezierCurveTo($1, $2, $3, $4, $5, $6);
     },
-           that->privado.canvas->privado.id, cp1x, cp1y, cp2x, cp2y, x, y);
+           that->privado.canvas->privado.handle, cp1x, cp1y, cp2x, cp2y, x, y);
 }
 static void context2d_quadraticCurveTo(CanvasRenderingContext2D *that, double cpx, double cpy, double x, double y)
 {
+    if (allFinite(4, (double[]){cpx, cpy, x, y}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_QUADRATIC_CURVE_TO, NULL, 4, cpx, cpy, x, y);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').quadraticCurveTo($1, $2, $3, $4);
+        Module['contexts'][$0].quadraticCurveTo($1, $2, $3, $4);
     },
-           that->privado.canvas->privado.id, cpx, cpy, x, y);
+           that->privado.canvas->privado.handle, cpx, cpy, x, y);
 }
 static void context2d_arc(CanvasRenderingContext2D *that, double x, double y, double radius, double startAngle, double endAngle)
 {
+    if (allFinite(5, (double[]){x, y, radius, startAngle, endAngle}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_ARC, NULL, 5, x, y, radius, startAngle, endAngle);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').arc($1, $2, $3, $4, $5);
+        Module['contexts'][$0].arc($1, $2, $3, $4, $5);
     },
-           that->privado.canvas->privado.id, x, y, radius, startAngle, endAngle);
+           that->privado.canvas->privado.handle, x, y, radius, startAngle, endAngle);
 }
 static void context2d_arcTo(CanvasRenderingContext2D *that, double x1, double y1, double x2, double y2, double radius)
 {
+    if (allFinite(5, (double[]){x1, y1, x2, y2, radius}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_ARC_TO, NULL, 5, x1, y1, x2, y2, radius);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').arcTo($1, $2, $3, $4, $5);
+        Module['contexts'][$0].arcTo($1, $2, $3, $4, $5);
     },
-           that->privado.canvas->privado.id, x1, y1, x2, y2, radius);
+           that->privado.canvas->privado.handle, x1, y1, x2, y2, radius);
 }
 static void context2d_ellipse(CanvasRenderingContext2D *that, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
 {
+    if (allFinite(7, (double[]){x, y, radiusX, radiusY, rotation, startAngle, endAngle}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_ELLIPSE, NULL, 7, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').ellipse($1, $2, $3, $4, $5, $6, $7);
+        Module['contexts'][$0].ellipse($1, $2, $3, $4, $5, $6, $7);
     },
-           that->privado.canvas->privado.id, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+           that->privado.canvas->privado.handle, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
 }
 static void context2d_rect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
 {
+    if (allFinite(4, (double[]){x, y, width, height}))
+        that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_RECT, NULL, 4, x, y, width, height);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').rect($1, $2, $3, $4);
+        Module['contexts'][$0].rect($1, $2, $3, $4);
     },
-           that->privado.canvas->privado.id, x, y, width, height);
+           that->privado.canvas->privado.handle, x, y, width, height);
 }
 static void context2d_fill(CanvasRenderingContext2D *that)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_FILL, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').fill();
+        Module['contexts'][$0].fill();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
 }
 static void context2d_stroke(CanvasRenderingContext2D *that)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_STROKE, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').stroke();
+        Module['contexts'][$0].stroke();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
+}
+static void context2d_strokeSegments(CanvasRenderingContext2D *that, float const *xyxy, int count)
+{
+    if (count <= 0)
+    {
+        context2d_beginPath(that); // nothing to stroke, but the path is still emptied
+        return;
+    }
+    that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordFloats(that, CANVAS_OP_STROKE_SEGMENTS, xyxy, count, 4);
+        return;
+    }
+    COUNT_CROSSING(that);
+    EM_ASM({
+        var ctx = Module['contexts'][$0];
+        var f = HEAPF32;
+        ctx.beginPath();
+        for (var p = $1 >> 2, e = p + 4 * $2; p < e; p += 4)
+        {
+            ctx.moveTo(f[p], f[p + 1]);
+            ctx.lineTo(f[p + 2], f[p + 3]);
+        }
+        ctx.stroke();
+    },
+           that->privado.canvas->privado.handle, xyxy, count);
+}
+static void context2d_fillCircles(CanvasRenderingContext2D *that, float const *xyr, int count)
+{
+    if (count <= 0)
+    {
+        context2d_beginPath(that);
+        return;
+    }
+    that->privado.pathEmpty = 0;
+    if (that->privado.commands.recording)
+    {
+        recordFloats(that, CANVAS_OP_FILL_CIRCLES, xyr, count, 3);
+        return;
+    }
+    COUNT_CROSSING(that);
+    EM_ASM({
+        var ctx = Module['contexts'][$0];
+        var f = HEAPF32;
+        ctx.beginPath();
+        for (var p = $1 >> 2, e = p + 3 * $2; p < e; p += 3)
+        {
+            ctx.moveTo(f[p] + f[p + 2], f[p + 1]);
+            ctx.arc(f[p], f[p + 1], f[p + 2], 0, 2 * Math.PI);
+        }
+        ctx.fill();
+    },
+           that->privado.canvas->privado.handle, xyr, count);
+}
+static void context2d_strokeSegmentBuckets(CanvasRenderingContext2D *that, float const *xyxy, int const *bucketStarts, int bucketCount,
+                                           double const *lineWidths, char const *const *strokeStyles)
+{
+    // record the buckets even if the context isn't recording, so they cross over together
+    int recording = that->privado.commands.recording;
+    that->privado.commands.recording = 1;
+    for (int bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        int count = bucketStarts[bucket + 1] - bucketStarts[bucket];
+        if (count <= 0)
+            continue;
+        context2d_setLineWidth(that, lineWidths[bucket]);
+        context2d_setStrokeStyle(that, strokeStyles[bucket]);
+        context2d_strokeSegments(that, xyxy + 4 * (size_t)bucketStarts[bucket], count);
+    }
+    if (!recording)
+    {
+        flushCommands(that);
+        that->privado.commands.recording = 0;
+    }
 }
 static void context2d_clip(CanvasRenderingContext2D *that)
 {
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_CLIP, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').clip();
+        Module['contexts'][$0].clip();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
 }
 static int context2d_isPointInPath(CanvasRenderingContext2D *that, double x, double y)
 {
+    flushCommands(that);
+    COUNT_CROSSING(that);
     return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').isPointInPath($1, $2);
+        return Module['contexts'][$0].isPointInPath($1, $2);
     },
-                      that->privado.canvas->privado.id, x, y);
+                      that->privado.canvas->privado.handle, x, y);
 }
 static int context2d_isPointInStroke(CanvasRenderingContext2D *that, double x, double y)
 {
+    flushCommands(that);
+    COUNT_CROSSING(that);
     return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').isPointInStroke($1, $2);
+        return Module['contexts'][$0].isPointInStroke($1, $2);
     },
-                      that->privado.canvas->privado.id, x, y);
+                      that->privado.canvas->privado.handle, x, y);
 }
 static void context2d_rotate(CanvasRenderingContext2D *that, double angle)
 {
+    if (angle == 0 || !isfinite(angle)) // no change, or ignored
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    that->privado.state.transformKnown = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_ROTATE, NULL, 1, angle);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').rotate($1);
+        Module['contexts'][$0].rotate($1);
     },
-           that->privado.canvas->privado.id, angle);
+           that->privado.canvas->privado.handle, angle);
 }
 static void context2d_scale(CanvasRenderingContext2D *that, double x, double y)
 {
+    if ((x == 1 && y == 1) || !allFinite(2, (double[]){x, y}))
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    that->privado.state.transformKnown = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_SCALE, NULL, 2, x, y);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').scale($1, $2);
+        Module['contexts'][$0].scale($1, $2);
     },
-           that->privado.canvas->privado.id, x, y);
+           that->privado.canvas->privado.handle, x, y);
 }
 static void context2d_translate(CanvasRenderingContext2D *that, double x, double y)
 {
+    if ((x == 0 && y == 0) || !allFinite(2, (double[]){x, y}))
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    that->privado.state.transformKnown = 0;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_TRANSLATE, NULL, 2, x, y);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').translate($1, $2);
+        Module['contexts'][$0].translate($1, $2);
     },
-           that->privado.canvas->privado.id, x, y);
+           that->privado.canvas->privado.handle, x, y);
 }
 static void context2d_transform(CanvasRenderingContext2D *that, double a, double b, double c, double d, double e, double f)
 {
+    if ((a == 1 && b == 0 && c == 0 && d == 1 && e == 0 && f == 0) || !allFinite(6, (double[]){a, b, c, d, e, f}))
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    that->privado.state.transformKnown = 0; // multiplying in C could round differently
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_TRANSFORM, NULL, 6, a, b, c, d, e, f);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').transform($1, $2, $3, $4, $5, $6);
+        Module['contexts'][$0].transform($1, $2, $3, $4, $5, $6);
     },
-           that->privado.canvas->privado.id, a, b, c, d, e, f);
+           that->privado.canvas->privado.handle, a, b, c, d, e, f);
 }
 static void context2d_setTransform(CanvasRenderingContext2D *that, double a, double b, double c, double d, double e, double f)
 {
+    double transform[6] = {forwardedNumber(that, a), forwardedNumber(that, b), forwardedNumber(that, c),
+                           forwardedNumber(that, d), forwardedNumber(that, e), forwardedNumber(that, f)};
+    if (!allFinite(6, transform) || (that->privado.state.transformKnown && memcmp(transform, that->privado.state.transform, sizeof(transform)) == 0))
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    knowTransform(&that->privado.state, transform[0], transform[1], transform[2], transform[3], transform[4], transform[5]);
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_SET_TRANSFORM, NULL, 6, a, b, c, d, e, f);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').setTransform($1, $2, $3, $4, $5, $6);
+        Module['contexts'][$0].setTransform($1, $2, $3, $4, $5, $6);
     },
-           that->privado.canvas->privado.id, a, b, c, d, e, f);
+           that->privado.canvas->privado.handle, a, b, c, d, e, f);
 }
 static void context2d_resetTransform(CanvasRenderingContext2D *that)
 {
+    CanvasState *state = &that->privado.state;
+    if (state->transformKnown && memcmp(state->transform, (double[]){1, 0, 0, 1, 0, 0}, sizeof(state->transform)) == 0)
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    knowTransform(state, 1, 0, 0, 1, 0, 0);
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_RESET_TRANSFORM, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').resetTransform();
+        Module['contexts'][$0].resetTransform();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
 }
 static void context2d_setGlobalAlpha(CanvasRenderingContext2D *that, double value)
 {
+    value = forwardedNumber(that, value);
+    if (!(value >= 0 && value <= 1) || value == that->privado.state.globalAlpha) // ignored, or already set
+    {
+        COUNT_ELIDED(that);
+        return;
+    }
+    that->privado.state.globalAlpha = value;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_SET_GLOBAL_ALPHA, NULL, 1, value);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').globalAlpha = $1;
+        Module['contexts'][$0].globalAlpha = $1;
     },
-           that->privado.canvas->privado.id, value);
+           that->privado.canvas->privado.handle, value);
 }
 static double context2d_getGlobalAlpha(CanvasRenderingContext2D *that)
 {
-    return EM_ASM_DOUBLE({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').globalAlpha;
+    if (!isnan(that->privado.state.globalAlpha))
+        return that->privado.state.globalAlpha;
+    flushCommands(that);
+    COUNT_CROSSING(that);
+    that->privado.state.globalAlpha = EM_ASM_DOUBLE({
+        return Module['contexts'][$0].globalAlpha;
     },
-                         that->privado.canvas->privado.id);
+                                                    that->privado.canvas->privado.handle);
+    return that->privado.state.globalAlpha;
 }
 static void context2d_setGlobalCompositeOperation(CanvasRenderingContext2D *that, char const *value)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').globalCompositeOperation = $1;
-    },
-           that->privado.canvas->privado.id, value);
+    setKeywordProperty(that, CANVAS_OP_SET_GLOBAL_COMPOSITE_OPERATION, "globalCompositeOperation", &that->privado.state.globalCompositeOperation, compositeOperations, value);
 }
 static char const *context2d_getGlobalCompositeOperation(CanvasRenderingContext2D *that)
 {
-    if (that->privado.globalCompositeOperation)
-        free(that->privado.globalCompositeOperation);
-    that->privado.globalCompositeOperation = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').globalCompositeOperation;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                                that->privado.canvas->privado.id);
-    return that->privado.globalCompositeOperation;
+    return getKeywordProperty(that, "globalCompositeOperation", &that->privado.state.globalCompositeOperation, compositeOperations);
 }
 static void context2d_save(CanvasRenderingContext2D *that)
 {
+    if (that->privado.stackCount == that->privado.stackCapacity)
+    {
+        that->privado.stackCapacity = that->privado.stackCapacity ? that->privado.stackCapacity * 2 : 8;
+        that->privado.stack = (CanvasState *)realloc(that->privado.stack, that->privado.stackCapacity * sizeof(CanvasState));
+    }
+    that->privado.stack[that->privado.stackCount++] = that->privado.state;
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_SAVE, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').save();
+        Module['contexts'][$0].save();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
 }
 static void context2d_restore(CanvasRenderingContext2D *that)
 {
+    if (that->privado.stackCount)
+        that->privado.state = that->privado.stack[--that->privado.stackCount];
+    else
+        forgetState(&that->privado.state); // this could restore a state saved before the context was mirrored
+    if (that->privado.commands.recording)
+    {
+        recordCommand(that, CANVAS_OP_RESTORE, NULL, 0);
+        return;
+    }
+    COUNT_CROSSING(that);
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').restore();
+        Module['contexts'][$0].restore();
     },
-           that->privado.canvas->privado.id);
+           that->privado.canvas->privado.handle);
 }
 static HTMLCanvasElement *context2d_getCanvas(CanvasRenderingContext2D *that)
 {
     return that->privado.canvas;
 }
+static void context2d_beginRecording(CanvasRenderingContext2D *that)
+{
+    that->privado.commands.recording = 1;
+}
+static void context2d_flush(CanvasRenderingContext2D *that)
+{
+    flushCommands(that);
+}
+static void context2d_endRecording(CanvasRenderingContext2D *that)
+{
+    flushCommands(that);
+    that->privado.commands.recording = 0;
+}
 /* End: CanvasRenderingContext2D static methods */
 
 static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char const *contextType)
 {
     if (strcmp(contextType, "2d") != 0)
         return NULL;
-    CanvasRenderingContext2D *ctx = (CanvasRenderingContext2D *)malloc(sizeof(CanvasRenderingContext2D));
+    CanvasRenderingContext2D *ctx = (CanvasRenderingContext2D *)objectPoolTake(&contextPool);
     /* Begin: set pseudo-privado fields */
+    EM_ASM({
+        var contexts = Module['contexts'] = Module['contexts'] || [];
+        contexts[$0] = contexts[$0] || Module['canvases'][$0].getContext('2d');
+    },
+           canvas->privado.handle);
     ctx->privado.canvas = canvas;
     strcpy(ctx->privado.contextType, contextType); // string field is a static length, no need to allocate
-    ctx->privado.font = NULL;
-    ctx->privado.textAlign = NULL;
-    ctx->privado.fillStyle = NULL;
-    ctx->privado.strokeStyle = NULL;
-    ctx->privado.lineCap = NULL;
-    ctx->privado.lineJoin = NULL;
-    ctx->privado.globalCompositeOperation = NULL;
+    forgetState(&ctx->privado.state); // the context could be one JavaScript already has
+    ctx->privado.stack = NULL;
+    ctx->privado.stackCount = 0;
+    ctx->privado.stackCapacity = 0;
+    ctx->privado.pathEmpty = 0;
+    ctx->privado.styles = (struct CanvasStyleCache *)calloc(1, sizeof(struct CanvasStyleCache));
+    ctx->privado.commands.words = NULL;
+    ctx->privado.commands.length = 0;
+    ctx->privado.commands.capacity = 0;
+    ctx->privado.commands.recording = 0;
     /* End: set pseudo-privado fields */
     ctx->clearRect = context2d_clearRect;
     ctx->fillRect = context2d_fillRect;
     ctx->strokeRect = context2d_strokeRect;
     ctx->fillText = context2d_fillText;
     ctx->strokeText = context2d_strokeText;
+    ctx->drawImage = context2d_drawImage;
     ctx->setLineWidth = context2d_setLineWidth;
     ctx->getLineWidth = context2d_getLineWidth;
     ctx->setLineCap = context2d_setLineCap;
@@ -515,6 +1354,9 @@ static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char c
     ctx->rect = context2d_rect;
     ctx->fill = context2d_fill;
     ctx->stroke = context2d_stroke;
+    ctx->strokeSegments = context2d_strokeSegments;
+    ctx->fillCircles = context2d_fillCircles;
+    ctx->strokeSegmentBuckets = context2d_strokeSegmentBuckets;
     ctx->clip = context2d_clip;
     ctx->isPointInPath = context2d_isPointInPath;
     ctx->isPointInStroke = context2d_isPointInStroke;
@@ -531,32 +1373,56 @@ static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char c
     ctx->save = context2d_save;
     ctx->restore = context2d_restore;
     ctx->getCanvas = context2d_getCanvas;
+    ctx->beginRecording = context2d_beginRecording;
+    ctx->flush = context2d_flush;
+    ctx->endRecording = context2d_endRecording;
+#ifdef CANVAS_STATS
+    instrumentContext(ctx);
+#endif
     return ctx;
 }
 
+int canTransferCanvas(char const *id)
+{
+#ifdef __EMSCRIPTEN_PTHREADS__
+    return EM_ASM_INT(
+        {
+            var element = document.getElementById(UTF8ToString($0));
+            return element && element.transferControlToOffscreen && typeof OffscreenCanvasRenderingContext2D != 'undefined' ? 1 : 0;
+        },
+        id);
+#else
+    return 0;
+#endif
+}
+
 void freeCanvas(HTMLCanvasElement *canvas)
 {
     if (canvas)
     {
+        // an element outside the document is only reachable through the table, so let it go
+        EM_ASM({
+            var canvases = Module['canvases'];
+            if (!canvases[$0].isConnected)
+            {
+                canvases[$0] = null;
+                Module['contexts'] && (Module['contexts'][$0] = null);
+            }
+        },
+               canvas->privado.handle);
         free(canvas->privado.id);
         if (canvas->privado.ctx)
         {
-            if (canvas->privado.ctx->privado.font)
-                free(canvas->privado.ctx->privado.font);
-            if (canvas->privado.ctx->privado.textAlign)
-                free(canvas->privado.ctx->privado.textAlign);
-            if (canvas->privado.ctx->privado.fillStyle)
-                free(canvas->privado.ctx->privado.fillStyle);
-            if (canvas->privado.ctx->privado.strokeStyle)
-                free(canvas->privado.ctx->privado.strokeStyle);
-            if (canvas->privado.ctx->privado.lineCap)
-                free(canvas->privado.ctx->privado.lineCap);
-            if (canvas->privado.ctx->privado.lineJoin)
-                free(canvas->privado.ctx->privado.lineJoin);
-            if (canvas->privado.ctx->privado.globalCompositeOperation)
-                free(canvas->privado.ctx->privado.globalCompositeOperation);
-            free(canvas->privado.ctx);
+            freeStyles(canvas->privado.ctx->privado.styles);
+            free(canvas->privado.ctx->privado.styles);
+            free(canvas->privado.ctx->privado.stack);
+            if (canvas->privado.ctx->privado.commands.words)
+                free(canvas->privado.ctx->privado.commands.words);
+#ifdef CANVAS_STATS
+            freeInstrumentation(canvas->privado.ctx);
+#endif
+            objectPoolGive(&contextPool, canvas->privado.ctx);
         }
-        free(canvas);
+        objectPoolGive(&canvasPool, canvas);
     }
 }
@@ -10,12 +10,16 @@
 #ifndef CANVAS_H
 #define CANVAS_H
 
+#ifndef HEADLESS
 #include <emscripten.h>
+#endif
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
 typedef struct HTMLCanvasElement HTMLCanvasElement;
 typedef struct CanvasRenderingContext2D CanvasRenderingContext2D;
+struct CanvasStyleCache;
 
 /**
  * Struct containing state and OO-like behavior of a CanvasRenderingContext2D structured similarly
@@ -43,34 +47,97 @@ typedef struct CanvasRenderingContext2D CanvasRenderingContext2D;
  *     ctx->fillRect(ctx, 50, 75, 100, 200);
  *     freeCanvas(canvas);
  * 
- * Some state is pseudo-encapsulated in the 'private' member struct, such as pointers to dynamically
- * allocated strings that will need to be freed when the HTMLCanvas is freed. Typically these
- * are from JavaScript calls, allocated to return them to the user. Alternatively, functions
- * with canonical string return types could be pigeon-holed into returning enum types, or
- * we could make the user responsible for buffer allocation and expect an additional by-reference
- * parameter to copy the string into. The in-JavaScript allocated string would need to be
- * freed after returning its contents to the user, and the user would not know how large the buffer
- * should be. So, when a string is exposed to the user, this struct keeps track of the pointers in
- * order to free them when the HTMLCanvas parent struct is freed.
+ * Some state is pseudo-encapsulated in the 'private' member struct. In particular, the web
+ * backend mirrors the context's state there (see CanvasState), and keeps a copy of it for
+ * every save(). Setters remember the value as JavaScript will read it back, and setting the
+ * value a property already has does nothing at all: the call is elided, and counted as such
+ * when CANVAS_STATS is defined. The same goes for calls that can't change anything, such as
+ * translate(0, 0), or beginPath() on an empty path. Getters answer from the mirror without
+ * calling into JavaScript or allocating.
+ * 
+ * A color or font string is handed to JavaScript once, the first time the context sees it,
+ * to find out what JavaScript turns it into (or whether it ignores it); after that the
+ * context looks it up in a cache of the strings it has seen. Keywords such as lineCap and
+ * invalid numbers are checked in C. The string a getter returns stays valid until the next
+ * call that sets or gets a string property of the same context.
+ * 
+ * The mirror assumes the context is only ever changed through this struct. Until a property
+ * has been set, its getter asks JavaScript once, and its setter always calls through.
+ * 
+ * Every function pointer is, by default, its own call into JavaScript. For code that issues
+ * many draw calls per frame, the context can instead record them into a command buffer in
+ * wasm memory and replay them all in one call:
+ * 
+ *     ctx->beginRecording(ctx);
+ *     ctx->beginPath(ctx);
+ *     ctx->moveTo(ctx, 0, 0);
+ *     ctx->lineTo(ctx, 100, 100);
+ *     ctx->stroke(ctx);
+ *     ctx->flush(ctx); // one JavaScript call for the four above
+ * 
+ * While recording, numeric arguments are stored as 32-bit floats. Getters and isPointIn*()
+ * flush any pending commands before they query JavaScript, so they always observe the
+ * effects of every call made before them; getters mostly don't have to ask.
+ * 
+ * Drawing many lines or dots of one style doesn't need a call per shape at all:
+ * strokeSegments() and fillCircles() take an array of 32-bit floats, which JavaScript reads
+ * straight out of wasm memory, and strokeSegmentBuckets() does the same for lines that come
+ * in several widths and styles.
+ */
+
+/**
+ * The part of a context's state that save() and restore() keep, as mirrored in C by the web
+ * backend. Numbers are NAN and strings NULL while they aren't known; the clipping region
+ * isn't mirrored at all.
  */
+typedef struct CanvasState
+{
+    double lineWidth;
+    double globalAlpha;
+    /** The current transform, as setTransform()'s a, b, c, d, e and f, if transformKnown. */
+    double transform[6];
+    int transformKnown;
+    /** These point into the context's style cache or at string literals; never free them. */
+    char const *font;
+    char const *textAlign;
+    char const *fillStyle;
+    char const *strokeStyle;
+    char const *lineCap;
+    char const *lineJoin;
+    char const *globalCompositeOperation;
+} CanvasState;
+
 struct CanvasRenderingContext2D
 {
     /**
      * This anonymous struct encapsulates fields of the CanvasRenderingContext2D struct
-     * intended to be private. These are primarily pointers to memory allocated from
-     * JavaScript calls so that they can be freed when the canvas is no longer in use.
+     * intended to be private.
      */
     struct
     {
         HTMLCanvasElement *canvas;
         char contextType[19];
-        char *font;
-        char *textAlign;
-        char *fillStyle;
-        char *strokeStyle;
-        char *lineCap;
-        char *lineJoin;
-        char *globalCompositeOperation;
+        /** The current state, and the states save() kept, oldest first. */
+        CanvasState state;
+        CanvasState *stack;
+        int stackCount;
+        int stackCapacity;
+        /** Whether the current path is known to have no subpaths. */
+        int pathEmpty;
+        /** The color and font strings the context has been given; see canvas.c. */
+        struct CanvasStyleCache *styles;
+        /** Recorded commands: opcodes, string lengths and bytes as words, numbers as float32. */
+        struct
+        {
+            uint32_t *words;
+            size_t length;
+            size_t capacity;
+            int recording;
+        } commands;
+#ifdef CANVAS_STATS
+        /** The wrapped function pointers and their counts; see canvas_stats.h. */
+        struct CanvasInstrumentation *instrumentation;
+#endif
     } privado;
     void (*clearRect)(CanvasRenderingContext2D *that, double x, double y, double width, double height);
     void (*fillRect)(CanvasRenderingContext2D *that, double x, double y, double width, double height);
@@ -79,6 +146,12 @@ struct CanvasRenderingContext2D
     void (*fillText)(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth);
     /** @param maxWidth optional parameter. provide a value < 0.0 to ignore this parameter. */
     void (*strokeText)(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth);
+    /**
+     * Draws the sw x sh rectangle of image at (sx, sy) into the dw x dh rectangle at (dx, dy),
+     * like JavaScript's nine-argument drawImage(). Give the same size twice to copy pixels
+     * without scaling.
+     */
+    void (*drawImage)(CanvasRenderingContext2D *that, HTMLCanvasElement *image, double sx, double sy, double sw, double sh, double dx, double dy, double dw, double dh);
     /* TextMetrics *(*measureText)(CanvasRenderingContext2D *that, char const *text); */ // that's a whole can of worms
     void (*setLineWidth)(CanvasRenderingContext2D *that, double value);
     double (*getLineWidth)(CanvasRenderingContext2D *that);
@@ -106,6 +179,28 @@ struct CanvasRenderingContext2D
     void (*rect)(CanvasRenderingContext2D *that, double x, double y, double width, double height);
     void (*fill)(CanvasRenderingContext2D *that);
     void (*stroke)(CanvasRenderingContext2D *that);
+    /**
+     * Strokes count line segments as a new path, as beginPath(), then moveTo(x0, y0) and
+     * lineTo(x1, y1) for every segment, then stroke() would, and leaves them as the current
+     * path. xyxy holds each segment's x0, y0, x1 and y1. JavaScript walks the array in wasm
+     * memory in the same call; while recording, the floats are copied into the buffer instead.
+     */
+    void (*strokeSegments)(CanvasRenderingContext2D *that, float const *xyxy, int count);
+    /**
+     * Fills count circles as a new path, as beginPath(), then moveTo(x + r, y) and
+     * arc(x, y, r, 0, 2 * M_PI) for every circle, then fill() would. xyr holds each circle's
+     * x, y and r.
+     */
+    void (*fillCircles)(CanvasRenderingContext2D *that, float const *xyr, int count);
+    /**
+     * Strokes bucketCount buckets of segments, each at its own line width and stroke style,
+     * as setLineWidth(), setStrokeStyle() and strokeSegments() would for every bucket that
+     * isn't empty, in order. Bucket b is segments bucketStarts[b] up to bucketStarts[b + 1]
+     * of xyxy. Once every style has been seen, the whole call is one call into JavaScript,
+     * whether or not the context is recording.
+     */
+    void (*strokeSegmentBuckets)(CanvasRenderingContext2D *that, float const *xyxy, int const *bucketStarts, int bucketCount,
+                                 double const *lineWidths, char const *const *strokeStyles);
     void (*clip)(CanvasRenderingContext2D *that);
     int (*isPointInPath)(CanvasRenderingContext2D *that, double x, double y);
     int (*isPointInStroke)(CanvasRenderingContext2D *that, double x, double y);
@@ -122,6 +217,12 @@ struct CanvasRenderingContext2D
     void (*save)(CanvasRenderingContext2D *that);
     void (*restore)(CanvasRenderingContext2D *that);
     HTMLCanvasElement *(*getCanvas)(CanvasRenderingContext2D *that);
+    /** Starts appending calls to the command buffer instead of making them right away. */
+    void (*beginRecording)(CanvasRenderingContext2D *that);
+    /** Replays the command buffer in a single call into JavaScript and empties it. */
+    void (*flush)(CanvasRenderingContext2D *that);
+    /** Flushes the command buffer and returns to making each call right away. */
+    void (*endRecording)(CanvasRenderingContext2D *that);
 };
 
 /**
@@ -152,20 +253,38 @@ struct HTMLCanvasElement
     {
         CanvasRenderingContext2D *ctx;
         char *id;
+        /**
+         * Index of the element in the JavaScript-side Module['canvases'] table, and of its 2d
+         * context in Module['contexts']. Resolved once by createCanvas() so that later calls
+         * need not decode the id or search the DOM.
+         */
+        int handle;
+        /**
+         * State owned by a backend other than the JavaScript one, such as the framebuffer and
+         * drawing state of the HEADLESS software rasterizer.
+         */
+        void *backend;
+        /** The width and height attributes as last read or set, so reading them stays in C. */
+        int width;
+        int height;
     } privado;
     /** 
      * Returns a positive integer reflecting the height HTML attribute of the <canvas> element
-     * interpreted in CSS pixels. The canvas height defaults to 150. 
+     * interpreted in CSS pixels. The canvas height defaults to 150. This does not ask the
+     * element: it's only correct as long as the size is only ever set through this struct.
      */
     int (*getHeight)(HTMLCanvasElement *that);
     /** 
      * Returns a positive integer reflecting the width HTML attribute of the <canvas> element
-     * interpreted in CSS pixels. The canvas width defaults to 300. 
+     * interpreted in CSS pixels. The canvas width defaults to 300. Like getHeight(), this does
+     * not ask the element.
      */
     int (*getWidth)(HTMLCanvasElement *that);
     /**
      * Sets the height HTML attribute of the <canvas> element. If an invalid value is specified,
-     * the default value of 150 is used. 
+     * the default value of 150 is used. As in JavaScript, this clears the canvas and resets its
+     * context's state and reallocates its backing store even if the height is unchanged, so
+     * compare against getHeight() first, and clear with clearRect() instead.
      */
     void (*setHeight)(HTMLCanvasElement *that, int height);
     /**
@@ -207,6 +326,28 @@ struct HTMLCanvasElement
  */
 HTMLCanvasElement *createCanvas(char const *name);
 
+#ifndef HEADLESS
+/**
+ * Returns nonzero if the canvas with the given id can have its control transferred to a
+ * pthread, by passing "#id" to emscripten_pthread_attr_settransferredcanvases() before
+ * creating it: the program was built with threads, the browser can draw 2d on an
+ * OffscreenCanvas, and the element is in the document. Then createCanvas() with the same id,
+ * on that thread, wraps the OffscreenCanvas, and draws to the element from there. The
+ * program has to be linked with -s OFFSCREENCANVAS_SUPPORT=1.
+ * 
+ * Each thread has its own JavaScript, so a canvas, and everything made from it, can only be
+ * used on the thread that created it, and a transferred canvas can't be created on any other.
+ */
+int canTransferCanvas(char const *id);
+#endif
+
+/**
+ * Creates a width x height canvas that is not part of the document, to draw into and then
+ * copy to a visible canvas with drawImage(). Free it with freeCanvas(), which also lets go of
+ * the element. On a thread other than the page's, it's an OffscreenCanvas.
+ */
+HTMLCanvasElement *createOffscreenCanvas(int width, int height);
+
 /**
  * Frees the dynamically allocated HTMLCanvasElement and any dynamically allocated
  * state as necessary. The DOM canvas element will still exist in HTML after freeing
@@ -214,4 +355,31 @@ HTMLCanvasElement *createCanvas(char const *name);
  */
 void freeCanvas(HTMLCanvasElement *canvas);
 
+#ifdef HEADLESS
+/**
+ * In a HEADLESS build, canvases are drawn by a software rasterizer into an in-memory RGBA
+ * framebuffer instead of the DOM. Text is not drawn, compositing is always source-over,
+ * strokes have no line joins, and drawImage() ignores the transform and samples the nearest
+ * source pixel.
+ * 
+ * Returns the canvas' framebuffer: getHeight() rows of getWidth() non-premultiplied RGBA
+ * pixels, top row first. The pointer is invalidated by resizing the canvas.
+ */
+uint8_t const *canvasPixels(HTMLCanvasElement *canvas);
+
+/**
+ * Turns rasterizing on or off. While it is off, drawing calls still build and transform
+ * their paths but leave the framebuffer untouched, so that timing them measures the cost of
+ * issuing the calls rather than of the software rasterizer. It is on by default. While it is
+ * off, the canvas has no framebuffer: canvasPixels() returns NULL and canvasWritePPM() fails.
+ */
+void canvasSetRasterizing(HTMLCanvasElement *canvas, int rasterizing);
+
+/**
+ * Writes the canvas' framebuffer, composited over black, to a binary PPM file.
+ * Returns 0 on success or -1 if the file could not be written.
+ */
+int canvasWritePPM(HTMLCanvasElement *canvas, char const *path);
+#endif
+
 #endif
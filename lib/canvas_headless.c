@@ -0,0 +1,1171 @@
+/**
+ * Implements HTMLCanvasElement and CanvasRenderingContext2D for HEADLESS builds, with a
+ * software rasterizer that draws into an in-memory RGBA framebuffer instead of the DOM. This
+ * lets programs written against canvas.h run, be profiled and be regression-tested natively.
+ * @file canvas_headless.c
+ */
+
+#include "canvas.h"
+#include "canvas_stats.h"
+#include "arena.h"
+#include <math.h>
+#include <stdio.h>
+
+/** Sub-scanlines sampled per pixel row. Horizontal coverage is computed exactly. */
+#define SUBSAMPLES 4
+/** Maximum distance, in pixels, between a flattened curve and the true one. */
+#define FLATNESS 0.1
+
+typedef struct
+{
+    float r, g, b, a;
+} Color;
+
+typedef struct
+{
+    double x, y;
+} Point;
+
+/** A run of points in a path. Points are stored already transformed to canvas pixels. */
+typedef struct
+{
+    int start;
+    int count;
+    int closed;
+} Subpath;
+
+/** One polygon edge, stored top to bottom; dir is +1 if it originally pointed down. */
+typedef struct
+{
+    double x0, y0, x1, y1;
+    int dir;
+} Edge;
+
+typedef struct
+{
+    double x;
+    int dir;
+} Crossing;
+
+/** What rasterize() does with the region it fills. */
+typedef enum
+{
+    RASTER_PAINT,
+    RASTER_ERASE,
+    /** Intersect the clipping region with it. */
+    RASTER_CLIP
+} RasterMode;
+
+/** Everything save() and restore() push and pop. */
+typedef struct
+{
+    Color fillColor;
+    Color strokeColor;
+    char fillStyle[32];
+    char strokeStyle[32];
+    double lineWidth;
+    double globalAlpha;
+    double transform[6];
+    char lineCap[8];
+    char lineJoin[8];
+    char font[64];
+    char textAlign[8];
+    char globalCompositeOperation[32];
+    /**
+     * The clipping region as one coverage byte per pixel, or NULL for none. A mask is never
+     * changed once made, so saved states share it; only the state that made it frees it.
+     */
+    uint8_t *clip;
+    int ownsClip;
+} DrawingState;
+
+typedef struct
+{
+    uint8_t *pixels;
+    int width;
+    int height;
+    DrawingState state;
+    DrawingState *stack;
+    int stackCount;
+    int stackCapacity;
+    /* the current path */
+    Point *points;
+    int pointCount;
+    int pointCapacity;
+    Subpath *subpaths;
+    int subpathCount;
+    int subpathCapacity;
+    Point lastUserPoint; // current point before transformation, for arcTo() and curves
+    /* scratch space for rasterizing */
+    Edge *edges;
+    int edgeCount;
+    int edgeCapacity;
+    Edge **active;
+    Crossing *crossings;
+    int activeCapacity;
+    int crossingCapacity;
+    float *coverage;
+    uint8_t *clipTarget; // the mask being made by clip()
+    uint8_t *spareClip;  // a mask no state uses any more, for the next clip() to reuse
+    int skipRasterizing; // set by canvasSetRasterizing(canvas, 0)
+} SoftwareCanvas;
+
+/** The wrappers come from pools, so making and freeing canvases doesn't churn the heap. */
+static ObjectPool canvasPool = OBJECT_POOL_INITIALIZER(HTMLCanvasElement, 4);
+static ObjectPool contextPool = OBJECT_POOL_INITIALIZER(CanvasRenderingContext2D, 4);
+static ObjectPool softwarePool = OBJECT_POOL_INITIALIZER(SoftwareCanvas, 4);
+
+static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char const *contextType);
+
+static SoftwareCanvas *software(CanvasRenderingContext2D *that)
+{
+    return (SoftwareCanvas *)that->privado.canvas->privado.backend;
+}
+
+/* Begin: growable arrays */
+static void *reserve(void *items, int *capacity, int needed, size_t size)
+{
+    if (needed > *capacity)
+    {
+        int grown = *capacity ? *capacity : 64;
+        while (grown < needed)
+            grown *= 2;
+        items = realloc(items, grown * size);
+        *capacity = grown;
+    }
+    return items;
+}
+/* End: growable arrays */
+
+/* Begin: colors */
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+/**
+ * Parses the CSS color forms this project uses: #rgb, #rgba, #rrggbb, #rrggbbaa, rgb(), rgba()
+ * and a handful of names. Returns 0 and leaves the color alone if the string isn't one of them,
+ * the same way an invalid assignment to fillStyle is ignored in JavaScript.
+ */
+static int parseColor(char const *string, Color *color)
+{
+    size_t length = strlen(string);
+    if (string[0] == '#' && (length == 4 || length == 5 || length == 7 || length == 9))
+    {
+        int digits = length == 4 || length == 5 ? 1 : 2;
+        int channels = (int)(length - 1) / digits;
+        float values[4] = {0, 0, 0, 1};
+        for (int i = 0; i < channels; ++i)
+        {
+            int high = hexDigit(string[1 + i * digits]);
+            int low = hexDigit(string[1 + i * digits + digits - 1]);
+            if (high < 0 || low < 0)
+                return 0;
+            values[i] = (high * 16 + low) / 255.0f;
+        }
+        color->r = values[0];
+        color->g = values[1];
+        color->b = values[2];
+        color->a = values[3];
+        return 1;
+    }
+    float r, g, b, a = 1;
+    if (sscanf(string, "rgba(%f ,%f ,%f ,%f )", &r, &g, &b, &a) == 4 || sscanf(string, "rgb(%f ,%f ,%f )", &r, &g, &b) == 3)
+    {
+        color->r = fminf(fmaxf(r, 0), 255) / 255;
+        color->g = fminf(fmaxf(g, 0), 255) / 255;
+        color->b = fminf(fmaxf(b, 0), 255) / 255;
+        color->a = fminf(fmaxf(a, 0), 1);
+        return 1;
+    }
+    static struct
+    {
+        char const *name;
+        Color color;
+    } const names[] = {
+        {"black", {0, 0, 0, 1}},
+        {"white", {1, 1, 1, 1}},
+        {"red", {1, 0, 0, 1}},
+        {"lime", {0, 1, 0, 1}},
+        {"blue", {0, 0, 1, 1}},
+        {"transparent", {0, 0, 0, 0}},
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        if (strcmp(string, names[i].name) == 0)
+        {
+            *color = names[i].color;
+            return 1;
+        }
+    }
+    return 0;
+}
+/** Serializes a color the way a browser reads fillStyle and strokeStyle back. */
+static void formatColor(Color color, char *out)
+{
+    int r = (int)lroundf(color.r * 255), g = (int)lroundf(color.g * 255), b = (int)lroundf(color.b * 255);
+    if (color.a >= 1)
+        sprintf(out, "#%02x%02x%02x", r, g, b);
+    else
+        sprintf(out, "rgba(%d, %d, %d, %g)", r, g, b, color.a);
+}
+/* End: colors */
+
+/* Begin: state */
+static void copyString(char *destination, size_t size, char const *source)
+{
+    snprintf(destination, size, "%s", source);
+}
+/** Frees the clipping masks of the current state and every saved one, and the spare. */
+static void freeClips(SoftwareCanvas *sc)
+{
+    if (sc->state.ownsClip)
+        free(sc->state.clip);
+    for (int i = 0; i < sc->stackCount; ++i)
+        if (sc->stack[i].ownsClip)
+            free(sc->stack[i].clip);
+    free(sc->spareClip);
+    sc->state.clip = NULL;
+    sc->state.ownsClip = 0;
+    sc->spareClip = NULL;
+}
+/** Returns an empty mask, reusing the spare if there is one, so clipping every frame doesn't allocate. */
+static uint8_t *takeClip(SoftwareCanvas *sc)
+{
+    uint8_t *mask = sc->spareClip;
+    sc->spareClip = NULL;
+    if (!mask)
+        return (uint8_t *)calloc((size_t)sc->width * sc->height, 1);
+    memset(mask, 0, (size_t)sc->width * sc->height);
+    return mask;
+}
+/** Keeps a mask no state uses any more as the spare, or frees it if there already is one. */
+static void giveClip(SoftwareCanvas *sc, uint8_t *mask)
+{
+    if (sc->spareClip)
+        free(mask);
+    else
+        sc->spareClip = mask;
+}
+static void resetState(SoftwareCanvas *sc)
+{
+    freeClips(sc);
+    DrawingState *state = &sc->state;
+    state->fillColor = (Color){0, 0, 0, 1};
+    state->strokeColor = (Color){0, 0, 0, 1};
+    strcpy(state->fillStyle, "#000000");
+    strcpy(state->strokeStyle, "#000000");
+    state->lineWidth = 1;
+    state->globalAlpha = 1;
+    double identity[6] = {1, 0, 0, 1, 0, 0};
+    memcpy(state->transform, identity, sizeof(identity));
+    strcpy(state->lineCap, "butt");
+    strcpy(state->lineJoin, "miter");
+    strcpy(state->font, "10px sans-serif");
+    strcpy(state->textAlign, "start");
+    strcpy(state->globalCompositeOperation, "source-over");
+    sc->stackCount = 0;
+    sc->pointCount = 0;
+    sc->subpathCount = 0;
+}
+static Point transformPoint(SoftwareCanvas *sc, double x, double y)
+{
+    double const *m = sc->state.transform;
+    return (Point){m[0] * x + m[2] * y + m[4], m[1] * x + m[3] * y + m[5]};
+}
+/** How much the current transform scales lengths, on average. */
+static double transformScale(SoftwareCanvas *sc)
+{
+    double const *m = sc->state.transform;
+    return sqrt(fabs(m[0] * m[3] - m[1] * m[2]));
+}
+/* End: state */
+
+/* Begin: path building */
+static void pathMoveTo(SoftwareCanvas *sc, double x, double y)
+{
+    sc->subpaths = (Subpath *)reserve(sc->subpaths, &sc->subpathCapacity, sc->subpathCount + 1, sizeof(Subpath));
+    sc->points = (Point *)reserve(sc->points, &sc->pointCapacity, sc->pointCount + 1, sizeof(Point));
+    sc->subpaths[sc->subpathCount++] = (Subpath){sc->pointCount, 1, 0};
+    sc->points[sc->pointCount++] = transformPoint(sc, x, y);
+    sc->lastUserPoint = (Point){x, y};
+}
+static void pathLineTo(SoftwareCanvas *sc, double x, double y)
+{
+    if (!sc->subpathCount)
+    {
+        pathMoveTo(sc, x, y);
+        return;
+    }
+    sc->points = (Point *)reserve(sc->points, &sc->pointCapacity, sc->pointCount + 1, sizeof(Point));
+    sc->points[sc->pointCount++] = transformPoint(sc, x, y);
+    sc->subpaths[sc->subpathCount - 1].count++;
+    sc->lastUserPoint = (Point){x, y};
+}
+static int segmentsFor(double length)
+{
+    int segments = (int)ceil(length / 4);
+    return segments < 4 ? 4 : segments > 256 ? 256 : segments;
+}
+/**
+ * Appends an elliptical arc, joined to the current point with a straight line as in
+ * JavaScript. Angles follow the spec: a clockwise sweep of 2pi or more is a full turn,
+ * otherwise the sweep is reduced into [0, 2pi), and the reverse when anticlockwise.
+ */
+static void pathArc(SoftwareCanvas *sc, double cx, double cy, double rx, double ry, double rotation, double start, double end, int anticlockwise)
+{
+    double sweep = end - start;
+    if (!anticlockwise)
+    {
+        if (sweep >= 2 * M_PI)
+            sweep = 2 * M_PI;
+        else if ((sweep = fmod(sweep, 2 * M_PI)) < 0)
+            sweep += 2 * M_PI;
+    }
+    else
+    {
+        if (sweep <= -2 * M_PI)
+            sweep = -2 * M_PI;
+        else if ((sweep = fmod(sweep, 2 * M_PI)) > 0)
+            sweep -= 2 * M_PI;
+    }
+    double radius = fmax(rx, ry) * transformScale(sc);
+    double step = radius > FLATNESS ? 2 * acos(1 - FLATNESS / radius) : M_PI / 2;
+    int segments = (int)ceil(fabs(sweep) / step);
+    if (segments < 1)
+        segments = 1;
+    if (segments > 1024)
+        segments = 1024;
+    double cosRotation = cos(rotation), sinRotation = sin(rotation);
+    for (int i = 0; i <= segments; ++i)
+    {
+        double t = start + sweep * i / segments;
+        double ex = rx * cos(t), ey = ry * sin(t);
+        pathLineTo(sc, cx + ex * cosRotation - ey * sinRotation, cy + ex * sinRotation + ey * cosRotation);
+    }
+}
+/* End: path building */
+
+/* Begin: rasterizing */
+static void addEdge(SoftwareCanvas *sc, Point a, Point b)
+{
+    if (a.y == b.y)
+        return; // horizontal edges never cross a scanline
+    sc->edges = (Edge *)reserve(sc->edges, &sc->edgeCapacity, sc->edgeCount + 1, sizeof(Edge));
+    if (a.y < b.y)
+        sc->edges[sc->edgeCount++] = (Edge){a.x, a.y, b.x, b.y, 1};
+    else
+        sc->edges[sc->edgeCount++] = (Edge){b.x, b.y, a.x, a.y, -1};
+}
+static void addPolygon(SoftwareCanvas *sc, Point const *points, int count)
+{
+    for (int i = 0; i < count; ++i)
+        addEdge(sc, points[i], points[(i + 1) % count]);
+}
+/** Adds a circle wound the same way as the quads in addStrokeSegment(), so they union. */
+static void addCircle(SoftwareCanvas *sc, Point center, double radius)
+{
+    int segments = radius > FLATNESS ? (int)ceil(M_PI / acos(1 - FLATNESS / radius)) : 4;
+    if (segments < 4)
+        segments = 4;
+    Point previous = {center.x + radius, center.y};
+    for (int i = 1; i <= segments; ++i)
+    {
+        double t = -2 * M_PI * i / segments;
+        Point next = {center.x + radius * cos(t), center.y + radius * sin(t)};
+        addEdge(sc, previous, next);
+        previous = next;
+    }
+}
+/** Adds the rectangle covered by a stroked segment, extended past both ends for square caps. */
+static void addStrokeSegment(SoftwareCanvas *sc, Point a, Point b, double halfWidth, int squareStart, int squareEnd)
+{
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double length = sqrt(dx * dx + dy * dy);
+    if (length == 0)
+        return;
+    dx /= length;
+    dy /= length;
+    if (squareStart)
+        a = (Point){a.x - dx * halfWidth, a.y - dy * halfWidth};
+    if (squareEnd)
+        b = (Point){b.x + dx * halfWidth, b.y + dy * halfWidth};
+    double nx = -dy * halfWidth, ny = dx * halfWidth;
+    Point quad[4] = {{a.x + nx, a.y + ny}, {b.x + nx, b.y + ny}, {b.x - nx, b.y - ny}, {a.x - nx, a.y - ny}};
+    addPolygon(sc, quad, 4);
+}
+static void addStroke(SoftwareCanvas *sc, Point const *points, int count, int closed)
+{
+    double halfWidth = sc->state.lineWidth * transformScale(sc) / 2;
+    int square = strcmp(sc->state.lineCap, "square") == 0;
+    int round = strcmp(sc->state.lineCap, "round") == 0;
+    int segments = closed ? count : count - 1;
+    for (int i = 0; i < segments; ++i)
+        addStrokeSegment(sc, points[i], points[(i + 1) % count], halfWidth, square && !closed && i == 0, square && !closed && i == segments - 1);
+    if (round && !closed && segments > 0)
+    {
+        addCircle(sc, points[0], halfWidth);
+        addCircle(sc, points[count - 1], halfWidth);
+    }
+}
+static int compareEdges(void const *a, void const *b)
+{
+    double difference = ((Edge const *)a)->y0 - ((Edge const *)b)->y0;
+    return (difference > 0) - (difference < 0);
+}
+static void addSpan(float *coverage, int width, double left, double right, float weight, int *spanMin, int *spanMax)
+{
+    if (left < 0)
+        left = 0;
+    if (right > width)
+        right = width;
+    if (left >= right)
+        return;
+    int first = (int)left, last = (int)right;
+    if (first == last)
+    {
+        coverage[first] += (float)(right - left) * weight;
+    }
+    else
+    {
+        coverage[first] += (float)(first + 1 - left) * weight;
+        for (int x = first + 1; x < last; ++x)
+            coverage[x] += weight;
+        if (last < width)
+            coverage[last] += (float)(right - last) * weight;
+    }
+    if (first < *spanMin)
+        *spanMin = first;
+    if ((last < width ? last : width - 1) > *spanMax)
+        *spanMax = last < width ? last : width - 1;
+}
+/** Composites a color, with 0-255 components, over a pixel with source-over. */
+static void blendPixel(uint8_t *pixel, float red, float green, float blue, float source)
+{
+    float destination = pixel[3] / 255.0f;
+    float out = source + destination * (1 - source);
+    if (out <= 0)
+        return;
+    pixel[0] = (uint8_t)lroundf((red * source + pixel[0] * destination * (1 - source)) / out);
+    pixel[1] = (uint8_t)lroundf((green * source + pixel[1] * destination * (1 - source)) / out);
+    pixel[2] = (uint8_t)lroundf((blue * source + pixel[2] * destination * (1 - source)) / out);
+    pixel[3] = (uint8_t)lroundf(out * 255);
+}
+/**
+ * Fills the region enclosed by the accumulated edges under the nonzero winding rule, then
+ * discards the edges. Depending on mode, the region is composited with source-over in the
+ * given color, erased, or written into sc->clipTarget, within the current clipping region.
+ */
+static void rasterize(SoftwareCanvas *sc, Color color, RasterMode mode)
+{
+    if (!sc->edgeCount || !sc->pixels || sc->skipRasterizing)
+    {
+        sc->edgeCount = 0;
+        return;
+    }
+    sc->active = (Edge **)reserve(sc->active, &sc->activeCapacity, sc->edgeCount, sizeof(Edge *));
+    sc->crossings = (Crossing *)reserve(sc->crossings, &sc->crossingCapacity, sc->edgeCount, sizeof(Crossing));
+    qsort(sc->edges, sc->edgeCount, sizeof(Edge), compareEdges);
+    double bottom = sc->edges[0].y1;
+    for (int i = 1; i < sc->edgeCount; ++i)
+        if (sc->edges[i].y1 > bottom)
+            bottom = sc->edges[i].y1;
+    int rowStart = sc->edges[0].y0 > 0 ? (int)sc->edges[0].y0 : 0;
+    int rowEnd = bottom < sc->height ? (int)ceil(bottom) : sc->height;
+    float alpha = color.a * (float)sc->state.globalAlpha;
+
+    int next = 0, activeCount = 0;
+    for (int row = rowStart; row < rowEnd; ++row)
+    {
+        int spanMin = sc->width, spanMax = -1;
+        for (int s = 0; s < SUBSAMPLES; ++s)
+        {
+            double y = row + (s + 0.5) / SUBSAMPLES;
+            while (next < sc->edgeCount && sc->edges[next].y0 <= y)
+                sc->active[activeCount++] = &sc->edges[next++];
+            int kept = 0, crossingCount = 0;
+            for (int i = 0; i < activeCount; ++i)
+            {
+                Edge *edge = sc->active[i];
+                if (edge->y1 <= y)
+                    continue;
+                sc->active[kept++] = edge;
+                double x = edge->x0 + (y - edge->y0) * (edge->x1 - edge->x0) / (edge->y1 - edge->y0);
+                int k = crossingCount++;
+                for (; k > 0 && sc->crossings[k - 1].x > x; --k)
+                    sc->crossings[k] = sc->crossings[k - 1];
+                sc->crossings[k] = (Crossing){x, edge->dir};
+            }
+            activeCount = kept;
+            int winding = 0;
+            double spanStart = 0;
+            for (int i = 0; i < crossingCount; ++i)
+            {
+                int before = winding;
+                winding += sc->crossings[i].dir;
+                if (!before && winding)
+                    spanStart = sc->crossings[i].x;
+                else if (before && !winding)
+                    addSpan(sc->coverage, sc->width, spanStart, sc->crossings[i].x, 1.0f / SUBSAMPLES, &spanMin, &spanMax);
+            }
+        }
+        uint8_t *pixel = sc->pixels + ((size_t)row * sc->width + spanMin) * 4;
+        uint8_t const *clip = sc->state.clip ? sc->state.clip + (size_t)row * sc->width : NULL;
+        for (int x = spanMin; x <= spanMax; ++x, pixel += 4)
+        {
+            float cover = fminf(sc->coverage[x], 1);
+            sc->coverage[x] = 0;
+            if (clip)
+                cover *= clip[x] / 255.0f;
+            if (cover <= 0)
+                continue;
+            if (mode == RASTER_CLIP)
+                sc->clipTarget[(size_t)row * sc->width + x] = (uint8_t)lroundf(cover * 255);
+            else if (mode == RASTER_ERASE)
+                pixel[3] = (uint8_t)lroundf(pixel[3] * (1 - cover));
+            else
+                blendPixel(pixel, color.r * 255, color.g * 255, color.b * 255, alpha * cover);
+        }
+    }
+    sc->edgeCount = 0;
+}
+static void rasterizeRect(SoftwareCanvas *sc, double x, double y, double width, double height, Color color, RasterMode mode)
+{
+    Point corners[4] = {transformPoint(sc, x, y), transformPoint(sc, x + width, y), transformPoint(sc, x + width, y + height), transformPoint(sc, x, y + height)};
+    addPolygon(sc, corners, 4);
+    rasterize(sc, color, mode);
+}
+/* End: rasterizing */
+
+/* Begin: HTMLCanvasElement static methods */
+static int canvas_getWidth(HTMLCanvasElement *that)
+{
+    return that->privado.width;
+}
+static int canvas_getHeight(HTMLCanvasElement *that)
+{
+    return that->privado.height;
+}
+/** Like assigning width or height in JavaScript, this clears the canvas and resets its context. */
+static void resize(HTMLCanvasElement *that, int width, int height)
+{
+    SoftwareCanvas *sc = (SoftwareCanvas *)that->privado.backend;
+    that->privado.width = sc->width = width;
+    that->privado.height = sc->height = height;
+    free(sc->pixels);
+    free(sc->coverage);
+    sc->pixels = NULL;
+    sc->coverage = NULL;
+    // with rasterizing off there is nothing to draw into, so huge canvases cost nothing
+    if (!sc->skipRasterizing)
+    {
+        sc->pixels = (uint8_t *)calloc((size_t)width * height, 4);
+        sc->coverage = (float *)calloc(width + 1, sizeof(float));
+    }
+    resetState(sc);
+}
+static void canvas_setWidth(HTMLCanvasElement *that, int width)
+{
+    resize(that, width >= 0 ? width : 300, canvas_getHeight(that));
+}
+static void canvas_setHeight(HTMLCanvasElement *that, int height)
+{
+    resize(that, canvas_getWidth(that), height >= 0 ? height : 150);
+}
+static CanvasRenderingContext2D *canvas_getContext(HTMLCanvasElement *that, char const *contextType)
+{
+    if (!that->privado.ctx)
+        that->privado.ctx = createContext(that, contextType);
+    return that->privado.ctx;
+}
+/* End: HTMLCanvasElement static methods */
+
+HTMLCanvasElement *createCanvas(char const *id)
+{
+    HTMLCanvasElement *c = (HTMLCanvasElement *)objectPoolTake(&canvasPool);
+    /* Begin: set pseudo-privado fields */
+    c->privado.id = (char *)malloc(strlen(id) + 1);
+    strcpy(c->privado.id, id);
+    c->privado.ctx = NULL; // we'll lazy-load the context when it's asked for
+    c->privado.handle = -1;
+    c->privado.backend = memset(objectPoolTake(&softwarePool), 0, sizeof(SoftwareCanvas));
+    /* End: set pseudo-privado fields */
+    c->getWidth = canvas_getWidth;
+    c->getHeight = canvas_getHeight;
+    c->setHeight = canvas_setHeight;
+    c->setWidth = canvas_setWidth;
+    c->getContext = canvas_getContext;
+    resize(c, 300, 150);
+    return c;
+}
+
+HTMLCanvasElement *createOffscreenCanvas(int width, int height)
+{
+    HTMLCanvasElement *c = createCanvas("");
+    resize(c, width, height);
+    return c;
+}
+
+/* Begin: CanvasRenderingContext2D static methods */
+static void context2d_clearRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    rasterizeRect(software(that), x, y, width, height, (Color){0, 0, 0, 0}, RASTER_ERASE);
+}
+static void context2d_fillRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    rasterizeRect(software(that), x, y, width, height, software(that)->state.fillColor, RASTER_PAINT);
+}
+static void context2d_strokeRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    SoftwareCanvas *sc = software(that);
+    Point corners[4] = {transformPoint(sc, x, y), transformPoint(sc, x + width, y), transformPoint(sc, x + width, y + height), transformPoint(sc, x, y + height)};
+    addStroke(sc, corners, 4, 1);
+    rasterize(sc, sc->state.strokeColor, RASTER_PAINT);
+}
+static void context2d_fillText(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth)
+{
+    // there are no fonts to draw text with
+}
+static void context2d_strokeText(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth)
+{
+    // there are no fonts to draw text with
+}
+static void context2d_drawImage(CanvasRenderingContext2D *that, HTMLCanvasElement *image, double sx, double sy, double sw, double sh, double dx, double dy, double dw, double dh)
+{
+    SoftwareCanvas *sc = software(that);
+    SoftwareCanvas *source = (SoftwareCanvas *)image->privado.backend;
+    if (!sc->pixels || sc->skipRasterizing || !source->pixels || sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0)
+        return;
+    // every destination pixel whose center is in the rectangle takes the source pixel under it
+    int left = (int)fmax(0, ceil(dx - 0.5)), right = (int)fmin(sc->width, ceil(dx + dw - 0.5));
+    int top = (int)fmax(0, ceil(dy - 0.5)), bottom = (int)fmin(sc->height, ceil(dy + dh - 0.5));
+    float alpha = (float)sc->state.globalAlpha;
+    for (int y = top; y < bottom; ++y)
+    {
+        int v = (int)floor(sy + (y + 0.5 - dy) * sh / dh);
+        if (v < 0 || v >= source->height)
+            continue;
+        uint8_t const *clip = sc->state.clip ? sc->state.clip + (size_t)y * sc->width : NULL;
+        for (int x = left; x < right; ++x)
+        {
+            int u = (int)floor(sx + (x + 0.5 - dx) * sw / dw);
+            if (u < 0 || u >= source->width)
+                continue;
+            uint8_t const *from = source->pixels + ((size_t)v * source->width + u) * 4;
+            float cover = clip ? clip[x] / 255.0f : 1;
+            if (from[3] && cover > 0)
+                blendPixel(sc->pixels + ((size_t)y * sc->width + x) * 4, from[0], from[1], from[2], from[3] / 255.0f * alpha * cover);
+        }
+    }
+}
+static void context2d_setLineWidth(CanvasRenderingContext2D *that, double value)
+{
+    if (value > 0 && isfinite(value)) // other values are ignored, as in JavaScript
+        software(that)->state.lineWidth = value;
+}
+static double context2d_getLineWidth(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.lineWidth;
+}
+static void context2d_setLineCap(CanvasRenderingContext2D *that, char const *type)
+{
+    if (strcmp(type, "butt") == 0 || strcmp(type, "round") == 0 || strcmp(type, "square") == 0)
+        copyString(software(that)->state.lineCap, sizeof(software(that)->state.lineCap), type);
+}
+static char const *context2d_getLineCap(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.lineCap;
+}
+static void context2d_setLineJoin(CanvasRenderingContext2D *that, char const *type)
+{
+    if (strcmp(type, "bevel") == 0 || strcmp(type, "round") == 0 || strcmp(type, "miter") == 0)
+        copyString(software(that)->state.lineJoin, sizeof(software(that)->state.lineJoin), type);
+}
+static char const *context2d_getLineJoin(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.lineJoin;
+}
+static char const *context2d_getFont(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.font;
+}
+static void context2d_setFont(CanvasRenderingContext2D *that, char const *value)
+{
+    copyString(software(that)->state.font, sizeof(software(that)->state.font), value);
+}
+static char const *context2d_getTextAlign(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.textAlign;
+}
+static void context2d_setTextAlign(CanvasRenderingContext2D *that, char const *value)
+{
+    copyString(software(that)->state.textAlign, sizeof(software(that)->state.textAlign), value);
+}
+static char const *context2d_getFillStyle(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.fillStyle;
+}
+static void context2d_setFillStyle(CanvasRenderingContext2D *that, char const *value)
+{
+    DrawingState *state = &software(that)->state;
+    if (parseColor(value, &state->fillColor))
+        formatColor(state->fillColor, state->fillStyle);
+}
+static char const *context2d_getStrokeStyle(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.strokeStyle;
+}
+static void context2d_setStrokeStyle(CanvasRenderingContext2D *that, char const *value)
+{
+    DrawingState *state = &software(that)->state;
+    if (parseColor(value, &state->strokeColor))
+        formatColor(state->strokeColor, state->strokeStyle);
+}
+static void context2d_beginPath(CanvasRenderingContext2D *that)
+{
+    software(that)->pointCount = 0;
+    software(that)->subpathCount = 0;
+}
+static void context2d_closePath(CanvasRenderingContext2D *that)
+{
+    SoftwareCanvas *sc = software(that);
+    if (!sc->subpathCount)
+        return;
+    Subpath *subpath = &sc->subpaths[sc->subpathCount - 1];
+    subpath->closed = 1;
+    // the next subpath starts where this one did
+    sc->subpaths = (Subpath *)reserve(sc->subpaths, &sc->subpathCapacity, sc->subpathCount + 1, sizeof(Subpath));
+    sc->points = (Point *)reserve(sc->points, &sc->pointCapacity, sc->pointCount + 1, sizeof(Point));
+    Point start = sc->points[sc->subpaths[sc->subpathCount - 1].start];
+    sc->subpaths[sc->subpathCount++] = (Subpath){sc->pointCount, 1, 0};
+    sc->points[sc->pointCount++] = start;
+}
+static void context2d_moveTo(CanvasRenderingContext2D *that, double x, double y)
+{
+    pathMoveTo(software(that), x, y);
+}
+static void context2d_lineTo(CanvasRenderingContext2D *that, double x, double y)
+{
+    pathLineTo(software(that), x, y);
+}
+static void context2d_bezierCurveTo(CanvasRenderingContext2D *that, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
+{
+    SoftwareCanvas *sc = software(that);
+    if (!sc->subpathCount)
+        pathMoveTo(sc, cp1x, cp1y);
+    Point p0 = sc->lastUserPoint;
+    double length = hypot(cp1x - p0.x, cp1y - p0.y) + hypot(cp2x - cp1x, cp2y - cp1y) + hypot(x - cp2x, y - cp2y);
+    int segments = segmentsFor(length * transformScale(sc));
+    for (int i = 1; i <= segments; ++i)
+    {
+        double t = (double)i / segments, u = 1 - t;
+        pathLineTo(sc,
+                   u * u * u * p0.x + 3 * u * u * t * cp1x + 3 * u * t * t * cp2x + t * t * t * x,
+                   u * u * u * p0.y + 3 * u * u * t * cp1y + 3 * u * t * t * cp2y + t * t * t * y);
+    }
+}
+static void context2d_quadraticCurveTo(CanvasRenderingContext2D *that, double cpx, double cpy, double x, double y)
+{
+    SoftwareCanvas *sc = software(that);
+    if (!sc->subpathCount)
+        pathMoveTo(sc, cpx, cpy);
+    Point p0 = sc->lastUserPoint;
+    double length = hypot(cpx - p0.x, cpy - p0.y) + hypot(x - cpx, y - cpy);
+    int segments = segmentsFor(length * transformScale(sc));
+    for (int i = 1; i <= segments; ++i)
+    {
+        double t = (double)i / segments, u = 1 - t;
+        pathLineTo(sc, u * u * p0.x + 2 * u * t * cpx + t * t * x, u * u * p0.y + 2 * u * t * cpy + t * t * y);
+    }
+}
+static void context2d_arc(CanvasRenderingContext2D *that, double x, double y, double radius, double startAngle, double endAngle)
+{
+    pathArc(software(that), x, y, radius, radius, 0, startAngle, endAngle, 0);
+}
+static void context2d_arcTo(CanvasRenderingContext2D *that, double x1, double y1, double x2, double y2, double radius)
+{
+    SoftwareCanvas *sc = software(that);
+    if (!sc->subpathCount)
+    {
+        pathMoveTo(sc, x1, y1);
+        return;
+    }
+    Point p0 = sc->lastUserPoint;
+    double ax = p0.x - x1, ay = p0.y - y1, bx = x2 - x1, by = y2 - y1;
+    double aLength = hypot(ax, ay), bLength = hypot(bx, by);
+    double cross = ax * by - ay * bx;
+    if (radius <= 0 || aLength == 0 || bLength == 0 || fabs(cross) < 1e-9 * aLength * bLength)
+    {
+        pathLineTo(sc, x1, y1);
+        return;
+    }
+    ax /= aLength;
+    ay /= aLength;
+    bx /= bLength;
+    by /= bLength;
+    double half = acos(fmax(-1, fmin(1, ax * bx + ay * by))) / 2;
+    double tangent = radius / tan(half);
+    double bisectorX = ax + bx, bisectorY = ay + by;
+    double bisectorLength = hypot(bisectorX, bisectorY);
+    double cx = x1 + bisectorX / bisectorLength * radius / sin(half);
+    double cy = y1 + bisectorY / bisectorLength * radius / sin(half);
+    double t1x = x1 + ax * tangent, t1y = y1 + ay * tangent;
+    double t2x = x1 + bx * tangent, t2y = y1 + by * tangent;
+    pathLineTo(sc, t1x, t1y);
+    pathArc(sc, cx, cy, radius, radius, 0, atan2(t1y - cy, t1x - cx), atan2(t2y - cy, t2x - cx), cross > 0);
+}
+static void context2d_ellipse(CanvasRenderingContext2D *that, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
+{
+    pathArc(software(that), x, y, radiusX, radiusY, rotation, startAngle, endAngle, 0);
+}
+static void context2d_rect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    SoftwareCanvas *sc = software(that);
+    pathMoveTo(sc, x, y);
+    pathLineTo(sc, x + width, y);
+    pathLineTo(sc, x + width, y + height);
+    pathLineTo(sc, x, y + height);
+    context2d_closePath(that);
+}
+static void context2d_fill(CanvasRenderingContext2D *that)
+{
+    SoftwareCanvas *sc = software(that);
+    for (int i = 0; i < sc->subpathCount; ++i)
+        addPolygon(sc, sc->points + sc->subpaths[i].start, sc->subpaths[i].count);
+    rasterize(sc, sc->state.fillColor, RASTER_PAINT);
+}
+static void context2d_stroke(CanvasRenderingContext2D *that)
+{
+    SoftwareCanvas *sc = software(that);
+    for (int i = 0; i < sc->subpathCount; ++i)
+        addStroke(sc, sc->points + sc->subpaths[i].start, sc->subpaths[i].count, sc->subpaths[i].closed);
+    rasterize(sc, sc->state.strokeColor, RASTER_PAINT);
+}
+static void context2d_strokeSegments(CanvasRenderingContext2D *that, float const *xyxy, int count)
+{
+    SoftwareCanvas *sc = software(that);
+    context2d_beginPath(that);
+    for (int i = 0; i < count; ++i, xyxy += 4)
+    {
+        pathMoveTo(sc, xyxy[0], xyxy[1]);
+        pathLineTo(sc, xyxy[2], xyxy[3]);
+    }
+    context2d_stroke(that);
+}
+static void context2d_fillCircles(CanvasRenderingContext2D *that, float const *xyr, int count)
+{
+    SoftwareCanvas *sc = software(that);
+    context2d_beginPath(that);
+    for (int i = 0; i < count; ++i, xyr += 3)
+    {
+        pathMoveTo(sc, (double)xyr[0] + xyr[2], xyr[1]);
+        pathArc(sc, xyr[0], xyr[1], xyr[2], xyr[2], 0, 0, 2 * M_PI, 0);
+    }
+    context2d_fill(that);
+}
+static void context2d_strokeSegmentBuckets(CanvasRenderingContext2D *that, float const *xyxy, int const *bucketStarts, int bucketCount,
+                                           double const *lineWidths, char const *const *strokeStyles)
+{
+    for (int bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        int count = bucketStarts[bucket + 1] - bucketStarts[bucket];
+        if (count <= 0)
+            continue;
+        context2d_setLineWidth(that, lineWidths[bucket]);
+        context2d_setStrokeStyle(that, strokeStyles[bucket]);
+        context2d_strokeSegments(that, xyxy + 4 * (size_t)bucketStarts[bucket], count);
+    }
+}
+static void context2d_clip(CanvasRenderingContext2D *that)
+{
+    SoftwareCanvas *sc = software(that);
+    if (!sc->pixels || sc->skipRasterizing)
+        return;
+    // the new mask is the path's coverage within the old one, so it starts empty
+    sc->clipTarget = takeClip(sc);
+    for (int i = 0; i < sc->subpathCount; ++i)
+        addPolygon(sc, sc->points + sc->subpaths[i].start, sc->subpaths[i].count);
+    rasterize(sc, sc->state.fillColor, RASTER_CLIP);
+    if (sc->state.ownsClip)
+        giveClip(sc, sc->state.clip);
+    sc->state.clip = sc->clipTarget;
+    sc->state.ownsClip = 1;
+    sc->clipTarget = NULL;
+}
+static int context2d_isPointInPath(CanvasRenderingContext2D *that, double x, double y)
+{
+    SoftwareCanvas *sc = software(that);
+    int winding = 0;
+    for (int i = 0; i < sc->subpathCount; ++i)
+    {
+        Point const *points = sc->points + sc->subpaths[i].start;
+        int count = sc->subpaths[i].count;
+        for (int k = 0; k < count; ++k)
+        {
+            Point a = points[k], b = points[(k + 1) % count];
+            if ((a.y <= y) != (b.y <= y) && a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y) > x)
+                winding += a.y < b.y ? 1 : -1;
+        }
+    }
+    return winding != 0;
+}
+static int context2d_isPointInStroke(CanvasRenderingContext2D *that, double x, double y)
+{
+    SoftwareCanvas *sc = software(that);
+    double halfWidth = sc->state.lineWidth * transformScale(sc) / 2;
+    for (int i = 0; i < sc->subpathCount; ++i)
+    {
+        Point const *points = sc->points + sc->subpaths[i].start;
+        int count = sc->subpaths[i].count;
+        int segments = sc->subpaths[i].closed ? count : count - 1;
+        for (int k = 0; k < segments; ++k)
+        {
+            Point a = points[k], b = points[(k + 1) % count];
+            double dx = b.x - a.x, dy = b.y - a.y;
+            double lengthSquared = dx * dx + dy * dy;
+            double t = lengthSquared ? ((x - a.x) * dx + (y - a.y) * dy) / lengthSquared : 0;
+            t = t < 0 ? 0 : t > 1 ? 1 : t;
+            if (hypot(a.x + t * dx - x, a.y + t * dy - y) <= halfWidth)
+                return 1;
+        }
+    }
+    return 0;
+}
+static void context2d_transform(CanvasRenderingContext2D *that, double a, double b, double c, double d, double e, double f)
+{
+    double *m = software(that)->state.transform;
+    double result[6] = {
+        m[0] * a + m[2] * b,
+        m[1] * a + m[3] * b,
+        m[0] * c + m[2] * d,
+        m[1] * c + m[3] * d,
+        m[0] * e + m[2] * f + m[4],
+        m[1] * e + m[3] * f + m[5],
+    };
+    memcpy(m, result, sizeof(result));
+}
+static void context2d_rotate(CanvasRenderingContext2D *that, double angle)
+{
+    context2d_transform(that, cos(angle), sin(angle), -sin(angle), cos(angle), 0, 0);
+}
+static void context2d_scale(CanvasRenderingContext2D *that, double x, double y)
+{
+    context2d_transform(that, x, 0, 0, y, 0, 0);
+}
+static void context2d_translate(CanvasRenderingContext2D *that, double x, double y)
+{
+    context2d_transform(that, 1, 0, 0, 1, x, y);
+}
+static void context2d_setTransform(CanvasRenderingContext2D *that, double a, double b, double c, double d, double e, double f)
+{
+    double *m = software(that)->state.transform;
+    m[0] = a;
+    m[1] = b;
+    m[2] = c;
+    m[3] = d;
+    m[4] = e;
+    m[5] = f;
+}
+static void context2d_resetTransform(CanvasRenderingContext2D *that)
+{
+    context2d_setTransform(that, 1, 0, 0, 1, 0, 0);
+}
+static void context2d_setGlobalAlpha(CanvasRenderingContext2D *that, double value)
+{
+    if (value >= 0 && value <= 1) // other values are ignored, as in JavaScript
+        software(that)->state.globalAlpha = value;
+}
+static double context2d_getGlobalAlpha(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.globalAlpha;
+}
+static void context2d_setGlobalCompositeOperation(CanvasRenderingContext2D *that, char const *value)
+{
+    copyString(software(that)->state.globalCompositeOperation, sizeof(software(that)->state.globalCompositeOperation), value);
+}
+static char const *context2d_getGlobalCompositeOperation(CanvasRenderingContext2D *that)
+{
+    return software(that)->state.globalCompositeOperation;
+}
+static void context2d_save(CanvasRenderingContext2D *that)
+{
+    SoftwareCanvas *sc = software(that);
+    sc->stack = (DrawingState *)reserve(sc->stack, &sc->stackCapacity, sc->stackCount + 1, sizeof(DrawingState));
+    sc->stack[sc->stackCount++] = sc->state;
+    sc->state.ownsClip = 0; // the saved copy frees it
+}
+static void context2d_restore(CanvasRenderingContext2D *that)
+{
+    SoftwareCanvas *sc = software(that);
+    if (sc->stackCount)
+    {
+        if (sc->state.ownsClip)
+            giveClip(sc, sc->state.clip);
+        sc->state = sc->stack[--sc->stackCount];
+    }
+}
+static HTMLCanvasElement *context2d_getCanvas(CanvasRenderingContext2D *that)
+{
+    return that->privado.canvas;
+}
+static void context2d_beginRecording(CanvasRenderingContext2D *that)
+{
+    // calls are already as cheap as a recorded command would be; nothing to do
+    that->privado.commands.recording = 1;
+}
+static void context2d_flush(CanvasRenderingContext2D *that)
+{
+}
+static void context2d_endRecording(CanvasRenderingContext2D *that)
+{
+    that->privado.commands.recording = 0;
+}
+/* End: CanvasRenderingContext2D static methods */
+
+static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char const *contextType)
+{
+    if (strcmp(contextType, "2d") != 0)
+        return NULL;
+    CanvasRenderingContext2D *ctx = (CanvasRenderingContext2D *)objectPoolTake(&contextPool);
+    /* Begin: set pseudo-privado fields */
+    ctx->privado.canvas = canvas;
+    strcpy(ctx->privado.contextType, contextType); // string field is a static length, no need to allocate
+    // strings are owned by the backend's drawing state, so these stay unused
+    ctx->privado.stack = NULL; // the SoftwareCanvas holds the state; nothing is mirrored
+    ctx->privado.stackCount = 0;
+    ctx->privado.stackCapacity = 0;
+    ctx->privado.pathEmpty = 0;
+    ctx->privado.styles = NULL;
+    ctx->privado.commands.words = NULL;
+    ctx->privado.commands.length = 0;
+    ctx->privado.commands.capacity = 0;
+    ctx->privado.commands.recording = 0;
+    /* End: set pseudo-privado fields */
+    ctx->clearRect = context2d_clearRect;
+    ctx->fillRect = context2d_fillRect;
+    ctx->strokeRect = context2d_strokeRect;
+    ctx->fillText = context2d_fillText;
+    ctx->strokeText = context2d_strokeText;
+    ctx->drawImage = context2d_drawImage;
+    ctx->setLineWidth = context2d_setLineWidth;
+    ctx->getLineWidth = context2d_getLineWidth;
+    ctx->setLineCap = context2d_setLineCap;
+    ctx->getLineCap = context2d_getLineCap;
+    ctx->setLineJoin = context2d_setLineJoin;
+    ctx->getLineJoin = context2d_getLineJoin;
+    ctx->setFont = context2d_setFont;
+    ctx->getFont = context2d_getFont;
+    ctx->setTextAlign = context2d_setTextAlign;
+    ctx->getTextAlign = context2d_getTextAlign;
+    ctx->setFillStyle = context2d_setFillStyle;
+    ctx->getFillStyle = context2d_getFillStyle;
+    ctx->setStrokeStyle = context2d_setStrokeStyle;
+    ctx->getStrokeStyle = context2d_getStrokeStyle;
+    ctx->beginPath = context2d_beginPath;
+    ctx->closePath = context2d_closePath;
+    ctx->moveTo = context2d_moveTo;
+    ctx->lineTo = context2d_lineTo;
+    ctx->bezierCurveTo = context2d_bezierCurveTo;
+    ctx->quadraticCurveTo = context2d_quadraticCurveTo;
+    ctx->arc = context2d_arc;
+    ctx->arcTo = context2d_arcTo;
+    ctx->ellipse = context2d_ellipse;
+    ctx->rect = context2d_rect;
+    ctx->fill = context2d_fill;
+    ctx->stroke = context2d_stroke;
+    ctx->strokeSegments = context2d_strokeSegments;
+    ctx->fillCircles = context2d_fillCircles;
+    ctx->strokeSegmentBuckets = context2d_strokeSegmentBuckets;
+    ctx->clip = context2d_clip;
+    ctx->isPointInPath = context2d_isPointInPath;
+    ctx->isPointInStroke = context2d_isPointInStroke;
+    ctx->rotate = context2d_rotate;
+    ctx->scale = context2d_scale;
+    ctx->translate = context2d_translate;
+    ctx->transform = context2d_transform;
+    ctx->setTransform = context2d_setTransform;
+    ctx->resetTransform = context2d_resetTransform;
+    ctx->setGlobalAlpha = context2d_setGlobalAlpha;
+    ctx->getGlobalAlpha = context2d_getGlobalAlpha;
+    ctx->setGlobalCompositeOperation = context2d_setGlobalCompositeOperation;
+    ctx->getGlobalCompositeOperation = context2d_getGlobalCompositeOperation;
+    ctx->save = context2d_save;
+    ctx->restore = context2d_restore;
+    ctx->getCanvas = context2d_getCanvas;
+    ctx->beginRecording = context2d_beginRecording;
+    ctx->flush = context2d_flush;
+    ctx->endRecording = context2d_endRecording;
+#ifdef CANVAS_STATS
+    instrumentContext(ctx);
+#endif
+    return ctx;
+}
+
+uint8_t const *canvasPixels(HTMLCanvasElement *canvas)
+{
+    return ((SoftwareCanvas *)canvas->privado.backend)->pixels;
+}
+
+void canvasSetRasterizing(HTMLCanvasElement *canvas, int rasterizing)
+{
+    SoftwareCanvas *sc = (SoftwareCanvas *)canvas->privado.backend;
+    sc->skipRasterizing = !rasterizing;
+    if (rasterizing && !sc->pixels)
+    {
+        sc->pixels = (uint8_t *)calloc((size_t)sc->width * sc->height, 4);
+        sc->coverage = (float *)calloc(sc->width + 1, sizeof(float));
+    }
+}
+
+int canvasWritePPM(HTMLCanvasElement *canvas, char const *path)
+{
+    SoftwareCanvas *sc = (SoftwareCanvas *)canvas->privado.backend;
+    if (!sc->pixels)
+        return -1;
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return -1;
+    fprintf(file, "P6\n%d %d\n255\n", sc->width, sc->height);
+    for (size_t i = 0; i < (size_t)sc->width * sc->height; ++i)
+    {
+        uint8_t const *pixel = sc->pixels + i * 4;
+        uint8_t rgb[3] = {
+            (uint8_t)((pixel[0] * pixel[3] + 127) / 255),
+            (uint8_t)((pixel[1] * pixel[3] + 127) / 255),
+            (uint8_t)((pixel[2] * pixel[3] + 127) / 255),
+        };
+        fwrite(rgb, 1, 3, file);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+void freeCanvas(HTMLCanvasElement *canvas)
+{
+    if (canvas)
+    {
+        SoftwareCanvas *sc = (SoftwareCanvas *)canvas->privado.backend;
+        freeClips(sc);
+        free(sc->pixels);
+        free(sc->stack);
+        free(sc->points);
+        free(sc->subpaths);
+        free(sc->edges);
+        free(sc->active);
+        free(sc->crossings);
+        free(sc->coverage);
+        objectPoolGive(&softwarePool, sc);
+        free(canvas->privado.id);
+#ifdef CANVAS_STATS
+        if (canvas->privado.ctx)
+            freeInstrumentation(canvas->privado.ctx);
+#endif
+        objectPoolGive(&contextPool, canvas->privado.ctx);
+        objectPoolGive(&canvasPool, canvas);
+    }
+}
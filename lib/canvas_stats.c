@@ -0,0 +1,531 @@
+/**
+ * Wraps every function pointer of a CanvasRenderingContext2D with one that counts its calls.
+ * Compiled only with CANVAS_STATS defined.
+ * @file canvas_stats.c
+ */
+
+#include "canvas_stats.h"
+
+#ifdef CANVAS_STATS
+#include "platform.h"
+
+/** The context's own function pointers, and what has been counted while calling them. */
+struct CanvasInstrumentation
+{
+    CanvasRenderingContext2D inner;
+    CanvasStats stats;
+    int timing;
+};
+
+static char const *const callNames[CANVAS_CALL_COUNT] = {
+    "clearRect",
+    "fillRect",
+    "strokeRect",
+    "fillText",
+    "strokeText",
+    "drawImage",
+    "setLineWidth",
+    "getLineWidth",
+    "setLineCap",
+    "getLineCap",
+    "setLineJoin",
+    "getLineJoin",
+    "getFont",
+    "setFont",
+    "setTextAlign",
+    "getTextAlign",
+    "setFillStyle",
+    "getFillStyle",
+    "setStrokeStyle",
+    "getStrokeStyle",
+    "beginPath",
+    "closePath",
+    "moveTo",
+    "lineTo",
+    "bezierCurveTo",
+    "quadraticCurveTo",
+    "arc",
+    "arcTo",
+    "ellipse",
+    "rect",
+    "fill",
+    "stroke",
+    "strokeSegments",
+    "fillCircles",
+    "strokeSegmentBuckets",
+    "clip",
+    "isPointInPath",
+    "isPointInStroke",
+    "rotate",
+    "scale",
+    "translate",
+    "transform",
+    "setTransform",
+    "resetTransform",
+    "setGlobalAlpha",
+    "getGlobalAlpha",
+    "setGlobalCompositeOperation",
+    "getGlobalCompositeOperation",
+    "save",
+    "restore",
+    "getCanvas",
+    "beginRecording",
+    "flush",
+    "endRecording"
+};
+
+static CanvasRenderingContext2D *inner(CanvasRenderingContext2D *that)
+{
+    return &that->privado.instrumentation->inner;
+}
+static double beginCall(CanvasRenderingContext2D *that, CanvasCall call)
+{
+    struct CanvasInstrumentation *instrumentation = that->privado.instrumentation;
+    ++instrumentation->stats.calls[call];
+    return instrumentation->timing ? performanceNow() : 0;
+}
+static void endCall(CanvasRenderingContext2D *that, CanvasCall call, double start)
+{
+    struct CanvasInstrumentation *instrumentation = that->privado.instrumentation;
+    if (instrumentation->timing)
+        instrumentation->stats.milliseconds[call] += performanceNow() - start;
+}
+
+/* Begin: counting wrappers */
+static void counted_clearRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    double start = beginCall(that, CANVAS_CALL_CLEAR_RECT);
+    inner(that)->clearRect(that, x, y, width, height);
+    endCall(that, CANVAS_CALL_CLEAR_RECT, start);
+}
+static void counted_fillRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    double start = beginCall(that, CANVAS_CALL_FILL_RECT);
+    inner(that)->fillRect(that, x, y, width, height);
+    endCall(that, CANVAS_CALL_FILL_RECT, start);
+}
+static void counted_strokeRect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    double start = beginCall(that, CANVAS_CALL_STROKE_RECT);
+    inner(that)->strokeRect(that, x, y, width, height);
+    endCall(that, CANVAS_CALL_STROKE_RECT, start);
+}
+static void counted_fillText(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth)
+{
+    double start = beginCall(that, CANVAS_CALL_FILL_TEXT);
+    inner(that)->fillText(that, text, x, y, maxWidth);
+    endCall(that, CANVAS_CALL_FILL_TEXT, start);
+}
+static void counted_strokeText(CanvasRenderingContext2D *that, char const *text, double x, double y, double maxWidth)
+{
+    double start = beginCall(that, CANVAS_CALL_STROKE_TEXT);
+    inner(that)->strokeText(that, text, x, y, maxWidth);
+    endCall(that, CANVAS_CALL_STROKE_TEXT, start);
+}
+static void counted_drawImage(CanvasRenderingContext2D *that, HTMLCanvasElement *image, double sx, double sy, double sw, double sh, double dx, double dy, double dw, double dh)
+{
+    double start = beginCall(that, CANVAS_CALL_DRAW_IMAGE);
+    inner(that)->drawImage(that, image, sx, sy, sw, sh, dx, dy, dw, dh);
+    endCall(that, CANVAS_CALL_DRAW_IMAGE, start);
+}
+static void counted_setLineWidth(CanvasRenderingContext2D *that, double value)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_LINE_WIDTH);
+    inner(that)->setLineWidth(that, value);
+    endCall(that, CANVAS_CALL_SET_LINE_WIDTH, start);
+}
+static double counted_getLineWidth(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_LINE_WIDTH);
+    double result = inner(that)->getLineWidth(that);
+    endCall(that, CANVAS_CALL_GET_LINE_WIDTH, start);
+    return result;
+}
+static void counted_setLineCap(CanvasRenderingContext2D *that, char const *type)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_LINE_CAP);
+    inner(that)->setLineCap(that, type);
+    endCall(that, CANVAS_CALL_SET_LINE_CAP, start);
+}
+static char const *counted_getLineCap(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_LINE_CAP);
+    char const *result = inner(that)->getLineCap(that);
+    endCall(that, CANVAS_CALL_GET_LINE_CAP, start);
+    return result;
+}
+static void counted_setLineJoin(CanvasRenderingContext2D *that, char const *type)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_LINE_JOIN);
+    inner(that)->setLineJoin(that, type);
+    endCall(that, CANVAS_CALL_SET_LINE_JOIN, start);
+}
+static char const *counted_getLineJoin(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_LINE_JOIN);
+    char const *result = inner(that)->getLineJoin(that);
+    endCall(that, CANVAS_CALL_GET_LINE_JOIN, start);
+    return result;
+}
+static char const *counted_getFont(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_FONT);
+    char const *result = inner(that)->getFont(that);
+    endCall(that, CANVAS_CALL_GET_FONT, start);
+    return result;
+}
+static void counted_setFont(CanvasRenderingContext2D *that, char const *value)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_FONT);
+    inner(that)->setFont(that, value);
+    endCall(that, CANVAS_CALL_SET_FONT, start);
+}
+static void counted_setTextAlign(CanvasRenderingContext2D *that, char const *value)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_TEXT_ALIGN);
+    inner(that)->setTextAlign(that, value);
+    endCall(that, CANVAS_CALL_SET_TEXT_ALIGN, start);
+}
+static char const *counted_getTextAlign(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_TEXT_ALIGN);
+    char const *result = inner(that)->getTextAlign(that);
+    endCall(that, CANVAS_CALL_GET_TEXT_ALIGN, start);
+    return result;
+}
+static void counted_setFillStyle(CanvasRenderingContext2D *that, char const *value)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_FILL_STYLE);
+    inner(that)->setFillStyle(that, value);
+    endCall(that, CANVAS_CALL_SET_FILL_STYLE, start);
+}
+static char const *counted_getFillStyle(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_FILL_STYLE);
+    char const *result = inner(that)->getFillStyle(that);
+    endCall(that, CANVAS_CALL_GET_FILL_STYLE, start);
+    return result;
+}
+static void counted_setStrokeStyle(CanvasRenderingContext2D *that, char const *value)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_STROKE_STYLE);
+    inner(that)->setStrokeStyle(that, value);
+    endCall(that, CANVAS_CALL_SET_STROKE_STYLE, start);
+}
+static char const *counted_getStrokeStyle(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_STROKE_STYLE);
+    char const *result = inner(that)->getStrokeStyle(that);
+    endCall(that, CANVAS_CALL_GET_STROKE_STYLE, start);
+    return result;
+}
+static void counted_beginPath(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_BEGIN_PATH);
+    inner(that)->beginPath(that);
+    endCall(that, CANVAS_CALL_BEGIN_PATH, start);
+}
+static void counted_closePath(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_CLOSE_PATH);
+    inner(that)->closePath(that);
+    endCall(that, CANVAS_CALL_CLOSE_PATH, start);
+}
+static void counted_moveTo(CanvasRenderingContext2D *that, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_MOVE_TO);
+    inner(that)->moveTo(that, x, y);
+    endCall(that, CANVAS_CALL_MOVE_TO, start);
+}
+static void counted_lineTo(CanvasRenderingContext2D *that, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_LINE_TO);
+    inner(that)->lineTo(that, x, y);
+    endCall(that, CANVAS_CALL_LINE_TO, start);
+}
+static void counted_bezierCurveTo(CanvasRenderingContext2D *that, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_BEZIER_CURVE_TO);
+    inner(that)->bezierCurveTo(that, cp1x, cp1y, cp2x, cp2y, x, y);
+    endCall(that, CANVAS_CALL_BEZIER_CURVE_TO, start);
+}
+static void counted_quadraticCurveTo(CanvasRenderingContext2D *that, double cpx, double cpy, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_QUADRATIC_CURVE_TO);
+    inner(that)->quadraticCurveTo(that, cpx, cpy, x, y);
+    endCall(that, CANVAS_CALL_QUADRATIC_CURVE_TO, start);
+}
+static void counted_arc(CanvasRenderingContext2D *that, double x, double y, double radius, double startAngle, double endAngle)
+{
+    double start = beginCall(that, CANVAS_CALL_ARC);
+    inner(that)->arc(that, x, y, radius, startAngle, endAngle);
+    endCall(that, CANVAS_CALL_ARC, start);
+}
+static void counted_arcTo(CanvasRenderingContext2D *that, double x1, double y1, double x2, double y2, double radius)
+{
+    double start = beginCall(that, CANVAS_CALL_ARC_TO);
+    inner(that)->arcTo(that, x1, y1, x2, y2, radius);
+    endCall(that, CANVAS_CALL_ARC_TO, start);
+}
+static void counted_ellipse(CanvasRenderingContext2D *that, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
+{
+    double start = beginCall(that, CANVAS_CALL_ELLIPSE);
+    inner(that)->ellipse(that, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+    endCall(that, CANVAS_CALL_ELLIPSE, start);
+}
+static void counted_rect(CanvasRenderingContext2D *that, double x, double y, double width, double height)
+{
+    double start = beginCall(that, CANVAS_CALL_RECT);
+    inner(that)->rect(that, x, y, width, height);
+    endCall(that, CANVAS_CALL_RECT, start);
+}
+static void counted_fill(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_FILL);
+    inner(that)->fill(that);
+    endCall(that, CANVAS_CALL_FILL, start);
+}
+static void counted_stroke(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_STROKE);
+    inner(that)->stroke(that);
+    endCall(that, CANVAS_CALL_STROKE, start);
+}
+static void counted_strokeSegments(CanvasRenderingContext2D *that, float const *xyxy, int count)
+{
+    double start = beginCall(that, CANVAS_CALL_STROKE_SEGMENTS);
+    inner(that)->strokeSegments(that, xyxy, count);
+    endCall(that, CANVAS_CALL_STROKE_SEGMENTS, start);
+}
+static void counted_fillCircles(CanvasRenderingContext2D *that, float const *xyr, int count)
+{
+    double start = beginCall(that, CANVAS_CALL_FILL_CIRCLES);
+    inner(that)->fillCircles(that, xyr, count);
+    endCall(that, CANVAS_CALL_FILL_CIRCLES, start);
+}
+static void counted_strokeSegmentBuckets(CanvasRenderingContext2D *that, float const *xyxy, int const *bucketStarts, int bucketCount,
+                                         double const *lineWidths, char const *const *strokeStyles)
+{
+    double start = beginCall(that, CANVAS_CALL_STROKE_SEGMENT_BUCKETS);
+    inner(that)->strokeSegmentBuckets(that, xyxy, bucketStarts, bucketCount, lineWidths, strokeStyles);
+    endCall(that, CANVAS_CALL_STROKE_SEGMENT_BUCKETS, start);
+}
+static void counted_clip(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_CLIP);
+    inner(that)->clip(that);
+    endCall(that, CANVAS_CALL_CLIP, start);
+}
+static int counted_isPointInPath(CanvasRenderingContext2D *that, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_IS_POINT_IN_PATH);
+    int result = inner(that)->isPointInPath(that, x, y);
+    endCall(that, CANVAS_CALL_IS_POINT_IN_PATH, start);
+    return result;
+}
+static int counted_isPointInStroke(CanvasRenderingContext2D *that, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_IS_POINT_IN_STROKE);
+    int result = inner(that)->isPointInStroke(that, x, y);
+    endCall(that, CANVAS_CALL_IS_POINT_IN_STROKE, start);
+    return result;
+}
+static void counted_rotate(CanvasRenderingContext2D *that, double angle)
+{
+    double start = beginCall(that, CANVAS_CALL_ROTATE);
+    inner(that)->rotate(that, angle);
+    endCall(that, CANVAS_CALL_ROTATE, start);
+}
+static void counted_scale(CanvasRenderingContext2D *that, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_SCALE);
+    inner(that)->scale(that, x, y);
+    endCall(that, CANVAS_CALL_SCALE, start);
+}
+static void counted_translate(CanvasRenderingContext2D *that, double x, double y)
+{
+    double start = beginCall(that, CANVAS_CALL_TRANSLATE);
+    inner(that)->translate(that, x, y);
+    endCall(that, CANVAS_CALL_TRANSLATE, start);
+}
+static void counted_transform(CanvasRenderingContext2D *that, double a, double b, double c, double d, double e, double f)
+{
+    double start = beginCall(that, CANVAS_CALL_TRANSFORM);
+    inner(that)->transform(that, a, b, c, d, e, f);
+    endCall(that, CANVAS_CALL_TRANSFORM, start);
+}
+static void counted_setTransform(CanvasRenderingContext2D *that, double a, double b, double c, double d, double e, double f)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_TRANSFORM);
+    inner(that)->setTransform(that, a, b, c, d, e, f);
+    endCall(that, CANVAS_CALL_SET_TRANSFORM, start);
+}
+static void counted_resetTransform(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_RESET_TRANSFORM);
+    inner(that)->resetTransform(that);
+    endCall(that, CANVAS_CALL_RESET_TRANSFORM, start);
+}
+static void counted_setGlobalAlpha(CanvasRenderingContext2D *that, double value)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_GLOBAL_ALPHA);
+    inner(that)->setGlobalAlpha(that, value);
+    endCall(that, CANVAS_CALL_SET_GLOBAL_ALPHA, start);
+}
+static double counted_getGlobalAlpha(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_GLOBAL_ALPHA);
+    double result = inner(that)->getGlobalAlpha(that);
+    endCall(that, CANVAS_CALL_GET_GLOBAL_ALPHA, start);
+    return result;
+}
+static void counted_setGlobalCompositeOperation(CanvasRenderingContext2D *that, char const *value)
+{
+    double start = beginCall(that, CANVAS_CALL_SET_GLOBAL_COMPOSITE_OPERATION);
+    inner(that)->setGlobalCompositeOperation(that, value);
+    endCall(that, CANVAS_CALL_SET_GLOBAL_COMPOSITE_OPERATION, start);
+}
+static char const *counted_getGlobalCompositeOperation(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_GLOBAL_COMPOSITE_OPERATION);
+    char const *result = inner(that)->getGlobalCompositeOperation(that);
+    endCall(that, CANVAS_CALL_GET_GLOBAL_COMPOSITE_OPERATION, start);
+    return result;
+}
+static void counted_save(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_SAVE);
+    inner(that)->save(that);
+    endCall(that, CANVAS_CALL_SAVE, start);
+}
+static void counted_restore(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_RESTORE);
+    inner(that)->restore(that);
+    endCall(that, CANVAS_CALL_RESTORE, start);
+}
+static HTMLCanvasElement *counted_getCanvas(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_GET_CANVAS);
+    HTMLCanvasElement *result = inner(that)->getCanvas(that);
+    endCall(that, CANVAS_CALL_GET_CANVAS, start);
+    return result;
+}
+static void counted_beginRecording(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_BEGIN_RECORDING);
+    inner(that)->beginRecording(that);
+    endCall(that, CANVAS_CALL_BEGIN_RECORDING, start);
+}
+static void counted_flush(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_FLUSH);
+    inner(that)->flush(that);
+    endCall(that, CANVAS_CALL_FLUSH, start);
+}
+static void counted_endRecording(CanvasRenderingContext2D *that)
+{
+    double start = beginCall(that, CANVAS_CALL_END_RECORDING);
+    inner(that)->endRecording(that);
+    endCall(that, CANVAS_CALL_END_RECORDING, start);
+}
+/* End: counting wrappers */
+
+char const *canvasCallName(CanvasCall call)
+{
+    return call >= 0 && call < CANVAS_CALL_COUNT ? callNames[call] : NULL;
+}
+
+void canvasStatsSnapshot(CanvasRenderingContext2D *ctx, CanvasStats *stats)
+{
+    *stats = ctx->privado.instrumentation->stats;
+}
+
+void canvasStatsReset(CanvasRenderingContext2D *ctx)
+{
+    memset(&ctx->privado.instrumentation->stats, 0, sizeof(CanvasStats));
+}
+
+void canvasStatsSetTiming(CanvasRenderingContext2D *ctx, int timing)
+{
+    ctx->privado.instrumentation->timing = timing;
+}
+
+void instrumentContext(CanvasRenderingContext2D *that)
+{
+    that->privado.instrumentation = (struct CanvasInstrumentation *)calloc(1, sizeof(struct CanvasInstrumentation));
+    that->privado.instrumentation->inner = *that;
+    that->clearRect = counted_clearRect;
+    that->fillRect = counted_fillRect;
+    that->strokeRect = counted_strokeRect;
+    that->fillText = counted_fillText;
+    that->strokeText = counted_strokeText;
+    that->drawImage = counted_drawImage;
+    that->setLineWidth = counted_setLineWidth;
+    that->getLineWidth = counted_getLineWidth;
+    that->setLineCap = counted_setLineCap;
+    that->getLineCap = counted_getLineCap;
+    that->setLineJoin = counted_setLineJoin;
+    that->getLineJoin = counted_getLineJoin;
+    that->getFont = counted_getFont;
+    that->setFont = counted_setFont;
+    that->setTextAlign = counted_setTextAlign;
+    that->getTextAlign = counted_getTextAlign;
+    that->setFillStyle = counted_setFillStyle;
+    that->getFillStyle = counted_getFillStyle;
+    that->setStrokeStyle = counted_setStrokeStyle;
+    that->getStrokeStyle = counted_getStrokeStyle;
+    that->beginPath = counted_beginPath;
+    that->closePath = counted_closePath;
+    that->moveTo = counted_moveTo;
+    that->lineTo = counted_lineTo;
+    that->bezierCurveTo = counted_bezierCurveTo;
+    that->quadraticCurveTo = counted_quadraticCurveTo;
+    that->arc = counted_arc;
+    that->arcTo = counted_arcTo;
+    that->ellipse = counted_ellipse;
+    that->rect = counted_rect;
+    that->fill = counted_fill;
+    that->stroke = counted_stroke;
+    that->strokeSegments = counted_strokeSegments;
+    that->fillCircles = counted_fillCircles;
+    that->strokeSegmentBuckets = counted_strokeSegmentBuckets;
+    that->clip = counted_clip;
+    that->isPointInPath = counted_isPointInPath;
+    that->isPointInStroke = counted_isPointInStroke;
+    that->rotate = counted_rotate;
+    that->scale = counted_scale;
+    that->translate = counted_translate;
+    that->transform = counted_transform;
+    that->setTransform = counted_setTransform;
+    that->resetTransform = counted_resetTransform;
+    that->setGlobalAlpha = counted_setGlobalAlpha;
+    that->getGlobalAlpha = counted_getGlobalAlpha;
+    that->setGlobalCompositeOperation = counted_setGlobalCompositeOperation;
+    that->getGlobalCompositeOperation = counted_getGlobalCompositeOperation;
+    that->save = counted_save;
+    that->restore = counted_restore;
+    that->getCanvas = counted_getCanvas;
+    that->beginRecording = counted_beginRecording;
+    that->flush = counted_flush;
+    that->endRecording = counted_endRecording;
+}
+
+void freeInstrumentation(CanvasRenderingContext2D *ctx)
+{
+    free(ctx->privado.instrumentation);
+    ctx->privado.instrumentation = NULL;
+}
+
+void countCrossing(CanvasRenderingContext2D *ctx)
+{
+    if (ctx && ctx->privado.instrumentation)
+        ++ctx->privado.instrumentation->stats.crossings;
+}
+
+void countElided(CanvasRenderingContext2D *ctx)
+{
+    if (ctx->privado.instrumentation)
+        ++ctx->privado.instrumentation->stats.elided;
+}
+#endif
@@ -0,0 +1,131 @@
+/**
+ * Optional instrumentation for CanvasRenderingContext2D: counts, and optionally times, the
+ * calls made through each function pointer of a context, along with the calls into
+ * JavaScript they end up making. Everything here exists only when the library is compiled
+ * with CANVAS_STATS defined; without it, contexts are not wrapped and cost nothing extra.
+ * 
+ * A typical use takes a snapshot once per frame:
+ * 
+ *     CanvasStats stats;
+ *     canvasStatsSnapshot(ctx, &stats);
+ *     canvasStatsReset(ctx);
+ *     printf("%lu strokes, %lu crossings, %lu elided\n", stats.calls[CANVAS_CALL_STROKE], stats.crossings, stats.elided);
+ * 
+ * @file canvas_stats.h
+ */
+#ifndef CANVAS_STATS_H
+#define CANVAS_STATS_H
+
+#ifdef CANVAS_STATS
+#include "canvas.h"
+
+/** One entry per function pointer of CanvasRenderingContext2D, in the order it declares them. */
+typedef enum CanvasCall
+{
+    CANVAS_CALL_CLEAR_RECT = 0,
+    CANVAS_CALL_FILL_RECT,
+    CANVAS_CALL_STROKE_RECT,
+    CANVAS_CALL_FILL_TEXT,
+    CANVAS_CALL_STROKE_TEXT,
+    CANVAS_CALL_DRAW_IMAGE,
+    CANVAS_CALL_SET_LINE_WIDTH,
+    CANVAS_CALL_GET_LINE_WIDTH,
+    CANVAS_CALL_SET_LINE_CAP,
+    CANVAS_CALL_GET_LINE_CAP,
+    CANVAS_CALL_SET_LINE_JOIN,
+    CANVAS_CALL_GET_LINE_JOIN,
+    CANVAS_CALL_GET_FONT,
+    CANVAS_CALL_SET_FONT,
+    CANVAS_CALL_SET_TEXT_ALIGN,
+    CANVAS_CALL_GET_TEXT_ALIGN,
+    CANVAS_CALL_SET_FILL_STYLE,
+    CANVAS_CALL_GET_FILL_STYLE,
+    CANVAS_CALL_SET_STROKE_STYLE,
+    CANVAS_CALL_GET_STROKE_STYLE,
+    CANVAS_CALL_BEGIN_PATH,
+    CANVAS_CALL_CLOSE_PATH,
+    CANVAS_CALL_MOVE_TO,
+    CANVAS_CALL_LINE_TO,
+    CANVAS_CALL_BEZIER_CURVE_TO,
+    CANVAS_CALL_QUADRATIC_CURVE_TO,
+    CANVAS_CALL_ARC,
+    CANVAS_CALL_ARC_TO,
+    CANVAS_CALL_ELLIPSE,
+    CANVAS_CALL_RECT,
+    CANVAS_CALL_FILL,
+    CANVAS_CALL_STROKE,
+    CANVAS_CALL_STROKE_SEGMENTS,
+    CANVAS_CALL_FILL_CIRCLES,
+    CANVAS_CALL_STROKE_SEGMENT_BUCKETS,
+    CANVAS_CALL_CLIP,
+    CANVAS_CALL_IS_POINT_IN_PATH,
+    CANVAS_CALL_IS_POINT_IN_STROKE,
+    CANVAS_CALL_ROTATE,
+    CANVAS_CALL_SCALE,
+    CANVAS_CALL_TRANSLATE,
+    CANVAS_CALL_TRANSFORM,
+    CANVAS_CALL_SET_TRANSFORM,
+    CANVAS_CALL_RESET_TRANSFORM,
+    CANVAS_CALL_SET_GLOBAL_ALPHA,
+    CANVAS_CALL_GET_GLOBAL_ALPHA,
+    CANVAS_CALL_SET_GLOBAL_COMPOSITE_OPERATION,
+    CANVAS_CALL_GET_GLOBAL_COMPOSITE_OPERATION,
+    CANVAS_CALL_SAVE,
+    CANVAS_CALL_RESTORE,
+    CANVAS_CALL_GET_CANVAS,
+    CANVAS_CALL_BEGIN_RECORDING,
+    CANVAS_CALL_FLUSH,
+    CANVAS_CALL_END_RECORDING,
+    CANVAS_CALL_COUNT
+} CanvasCall;
+
+typedef struct CanvasStats
+{
+    /** How many times each function pointer was called. */
+    unsigned long calls[CANVAS_CALL_COUNT];
+    /**
+     * Total time spent in each function pointer, in milliseconds, while timing is on. Calls
+     * that are being recorded return almost immediately; their cost shows up in flush().
+     */
+    double milliseconds[CANVAS_CALL_COUNT];
+    /**
+     * Calls into JavaScript, from the context and from its canvas' getters and setters. A
+     * flush() of a non-empty command buffer is one. Always 0 in a HEADLESS build.
+     */
+    unsigned long crossings;
+    /**
+     * Calls that returned without doing anything because the state they set was already
+     * set, or because they couldn't change it (see canvas.h). They are counted in calls, too.
+     * Always 0 in a HEADLESS build.
+     */
+    unsigned long elided;
+} CanvasStats;
+
+/** Returns the name of the function pointer, such as "beginPath". */
+char const *canvasCallName(CanvasCall call);
+
+/** Copies the counts accumulated since the context was created or last reset. */
+void canvasStatsSnapshot(CanvasRenderingContext2D *ctx, CanvasStats *stats);
+
+/** Sets every count and time back to zero. */
+void canvasStatsReset(CanvasRenderingContext2D *ctx);
+
+/**
+ * Turns timing on or off. Timing reads the clock twice per call, which is noticeable for
+ * calls that only append to the command buffer, so it is off by default.
+ */
+void canvasStatsSetTiming(CanvasRenderingContext2D *ctx, int timing);
+
+/**
+ * Used by the backends. instrumentContext() moves the context's function pointers aside and
+ * replaces them with counting wrappers; freeInstrumentation() releases what it allocated.
+ * countCrossing() counts one call into JavaScript against ctx, which may be NULL, and
+ * countElided() one call that was skipped.
+ */
+void instrumentContext(CanvasRenderingContext2D *ctx);
+void freeInstrumentation(CanvasRenderingContext2D *ctx);
+void countCrossing(CanvasRenderingContext2D *ctx);
+void countElided(CanvasRenderingContext2D *ctx);
+#endif
+
+#endif
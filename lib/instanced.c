@@ -0,0 +1,228 @@
+/**
+ * Implements InstancedRenderer with WebGL2 instanced draws, from C to be compiled with
+ * Emscripten.
+ * @file instanced.c
+ */
+
+#include "instanced.h"
+
+/* Begin: InstancedRenderer static methods */
+static void instanced_beginFrame(InstancedRenderer *that, int width, int height)
+{
+    HTMLCanvasElement *canvas = that->privado.canvas;
+    // resizing reallocates the drawing buffer, so it's only done when the size changes
+    if (canvas->getWidth(canvas) != width)
+        canvas->setWidth(canvas, width);
+    if (canvas->getHeight(canvas) != height)
+        canvas->setHeight(canvas, height);
+    EM_ASM({
+        var gl = Module['renderers'][$0].gl;
+        gl.viewport(0, 0, $1, $2);
+        gl.clearColor(0, 0, 0, 0);
+        gl.clear(gl.COLOR_BUFFER_BIT);
+    },
+           that->privado.handle, width, height);
+}
+static void instanced_drawLines(InstancedRenderer *that, float const *lines, int count, float red, float green, float blue)
+{
+    if (count <= 0)
+        return;
+    EM_ASM({
+        var renderer = Module['renderers'][$0];
+        var gl = renderer.gl;
+        gl.useProgram(renderer.lineProgram);
+        gl.uniform2f(renderer.lineResolution, gl.drawingBufferWidth, gl.drawingBufferHeight);
+        gl.uniform3f(renderer.lineColor, $3, $4, $5);
+        gl.bindBuffer(gl.ARRAY_BUFFER, renderer.lineInstances);
+        gl.bufferData(gl.ARRAY_BUFFER, HEAPF32.subarray($1 >> 2, ($1 >> 2) + $2 * 6), gl.STREAM_DRAW);
+        gl.bindVertexArray(renderer.lineArray);
+        gl.drawArraysInstanced(gl.TRIANGLE_STRIP, 0, 4, $2);
+        gl.bindVertexArray(null);
+    },
+           that->privado.handle, lines, count, red, green, blue);
+}
+static void instanced_drawDots(InstancedRenderer *that, float const *centers, int count, float radius, float red, float green, float blue)
+{
+    if (count <= 0)
+        return;
+    EM_ASM({
+        var renderer = Module['renderers'][$0];
+        var gl = renderer.gl;
+        gl.useProgram(renderer.dotProgram);
+        gl.uniform2f(renderer.dotResolution, gl.drawingBufferWidth, gl.drawingBufferHeight);
+        gl.uniform1f(renderer.dotRadius, $3);
+        gl.uniform3f(renderer.dotColor, $4, $5, $6);
+        gl.bindBuffer(gl.ARRAY_BUFFER, renderer.dotInstances);
+        gl.bufferData(gl.ARRAY_BUFFER, HEAPF32.subarray($1 >> 2, ($1 >> 2) + $2 * 2), gl.STREAM_DRAW);
+        gl.bindVertexArray(renderer.dotArray);
+        gl.drawArraysInstanced(gl.TRIANGLE_STRIP, 0, 4, $2);
+        gl.bindVertexArray(null);
+    },
+           that->privado.handle, centers, count, radius, red, green, blue);
+}
+/* End: InstancedRenderer static methods */
+
+InstancedRenderer *createInstancedRenderer(HTMLCanvasElement *canvas)
+{
+    // Both programs draw a four-vertex strip per instance. corner.x runs 0 to 1 along a line
+    // (or -1 to 1 across a dot, after remapping) and corner.y runs -1 to 1 across it. Quads
+    // are padded by half a pixel (a pixel for dots) so the antialiased edge has room.
+    int handle = EM_ASM_INT({
+        var canvas = Module['canvases'][$0];
+        var gl = canvas.getContext("webgl2", {antialias: false, premultipliedAlpha: true});
+        if (!gl)
+            return -1;
+        var compile = function(vertexSource, fragmentSource) {
+            var program = gl.createProgram();
+            // (array literals are parenthesized so the C preprocessor doesn't split them at commas)
+            ([[gl.VERTEX_SHADER, vertexSource], [gl.FRAGMENT_SHADER, fragmentSource]]).forEach(function(stage) {
+                var shader = gl.createShader(stage[0]);
+                gl.shaderSource(shader, stage[1]);
+                gl.compileShader(shader);
+                if (!gl.getShaderParameter(shader, gl.COMPILE_STATUS))
+                    console.error(gl.getShaderInfoLog(shader));
+                gl.attachShader(program, shader);
+                gl.deleteShader(shader);
+            });
+            gl.linkProgram(program);
+            if (!gl.getProgramParameter(program, gl.LINK_STATUS))
+            {
+                console.error(gl.getProgramInfoLog(program));
+                gl.deleteProgram(program);
+                return null;
+            }
+            return program;
+        };
+        var lineProgram = compile(
+            "#version 300 es\n" +
+            "layout(location = 0) in vec2 corner;\n" +
+            "layout(location = 1) in vec4 endpoints;\n" +
+            "layout(location = 2) in vec2 style;\n" +
+            "uniform vec2 resolution;\n" +
+            "out float across;\n" +
+            "out float halfWidth;\n" +
+            "out float alpha;\n" +
+            "void main() {\n" +
+            "    vec2 delta = endpoints.zw - endpoints.xy;\n" +
+            "    float len = length(delta);\n" +
+            "    vec2 along = len > 0.0 ? delta / len : vec2(1.0, 0.0);\n" +
+            "    halfWidth = max(style.x, 1.0) * 0.5;\n" +
+            "    alpha = style.y * min(style.x, 1.0);\n" +
+            "    across = corner.y * (halfWidth + 0.5);\n" +
+            "    vec2 position = mix(endpoints.xy, endpoints.zw, corner.x) + vec2(-along.y, along.x) * across;\n" +
+            "    vec2 clip = position / resolution * 2.0 - 1.0;\n" +
+            "    gl_Position = vec4(clip.x, -clip.y, 0.0, 1.0);\n" +
+            "}\n",
+            "#version 300 es\n" +
+            "precision mediump float;\n" +
+            "uniform vec3 color;\n" +
+            "in float across;\n" +
+            "in float halfWidth;\n" +
+            "in float alpha;\n" +
+            "out vec4 fragment;\n" +
+            "void main() {\n" +
+            "    float coverage = clamp(halfWidth + 0.5 - abs(across), 0.0, 1.0);\n" +
+            "    fragment = vec4(color, 1.0) * (alpha * coverage);\n" +
+            "}\n");
+        var dotProgram = compile(
+            "#version 300 es\n" +
+            "layout(location = 0) in vec2 corner;\n" +
+            "layout(location = 1) in vec2 center;\n" +
+            "uniform vec2 resolution;\n" +
+            "uniform float radius;\n" +
+            "out vec2 offset;\n" +
+            "void main() {\n" +
+            "    offset = vec2(corner.x * 2.0 - 1.0, corner.y) * (radius + 1.0);\n" +
+            "    vec2 clip = (center + offset) / resolution * 2.0 - 1.0;\n" +
+            "    gl_Position = vec4(clip.x, -clip.y, 0.0, 1.0);\n" +
+            "}\n",
+            "#version 300 es\n" +
+            "precision mediump float;\n" +
+            "uniform vec3 color;\n" +
+            "uniform float radius;\n" +
+            "in vec2 offset;\n" +
+            "out vec4 fragment;\n" +
+            "void main() {\n" +
+            "    float coverage = clamp(radius + 0.5 - length(offset), 0.0, 1.0);\n" +
+            "    fragment = vec4(color, 1.0) * coverage;\n" +
+            "}\n");
+        if (!lineProgram || !dotProgram)
+            return -1;
+
+        var corners = gl.createBuffer();
+        gl.bindBuffer(gl.ARRAY_BUFFER, corners);
+        gl.bufferData(gl.ARRAY_BUFFER, new Float32Array([0, -1, 1, -1, 0, 1, 1, 1]), gl.STATIC_DRAW);
+        // attributes is a list of [location, size, offset] in floats, all per instance
+        var vertexArray = function(instances, stride, attributes) {
+            var array = gl.createVertexArray();
+            gl.bindVertexArray(array);
+            gl.bindBuffer(gl.ARRAY_BUFFER, corners);
+            gl.enableVertexAttribArray(0);
+            gl.vertexAttribPointer(0, 2, gl.FLOAT, false, 0, 0);
+            gl.bindBuffer(gl.ARRAY_BUFFER, instances);
+            attributes.forEach(function(attribute) {
+                gl.enableVertexAttribArray(attribute[0]);
+                gl.vertexAttribPointer(attribute[0], attribute[1], gl.FLOAT, false, stride * 4, attribute[2] * 4);
+                gl.vertexAttribDivisor(attribute[0], 1);
+            });
+            gl.bindVertexArray(null);
+            return array;
+        };
+        var lineInstances = gl.createBuffer();
+        var dotInstances = gl.createBuffer();
+        gl.enable(gl.BLEND);
+        gl.blendFunc(gl.ONE, gl.ONE_MINUS_SRC_ALPHA); // source-over for premultiplied colors
+
+        var renderers = Module['renderers'] = Module['renderers'] || [];
+        return renderers.push({
+            gl: gl,
+            corners: corners,
+            lineProgram: lineProgram,
+            lineResolution: gl.getUniformLocation(lineProgram, "resolution"),
+            lineColor: gl.getUniformLocation(lineProgram, "color"),
+            lineInstances: lineInstances,
+            lineArray: vertexArray(lineInstances, 6, [[1, 4, 0], [2, 2, 4]]),
+            dotProgram: dotProgram,
+            dotResolution: gl.getUniformLocation(dotProgram, "resolution"),
+            dotRadius: gl.getUniformLocation(dotProgram, "radius"),
+            dotColor: gl.getUniformLocation(dotProgram, "color"),
+            dotInstances: dotInstances,
+            dotArray: vertexArray(dotInstances, 2, [[1, 2, 0]])
+        }) - 1;
+    },
+                            canvas->privado.handle);
+    if (handle < 0)
+        return NULL;
+
+    InstancedRenderer *r = (InstancedRenderer *)malloc(sizeof(InstancedRenderer));
+    /* Begin: set pseudo-privado fields */
+    r->privado.canvas = canvas;
+    r->privado.handle = handle;
+    r->privado.context = NULL;
+    /* End: set pseudo-privado fields */
+    r->beginFrame = instanced_beginFrame;
+    r->drawLines = instanced_drawLines;
+    r->drawDots = instanced_drawDots;
+    return r;
+}
+
+void freeInstancedRenderer(InstancedRenderer *renderer)
+{
+    if (renderer)
+    {
+        EM_ASM({
+            var renderer = Module['renderers'][$0];
+            var gl = renderer.gl;
+            ([renderer.corners, renderer.lineInstances, renderer.dotInstances]).forEach(function(buffer) {
+                gl.deleteBuffer(buffer);
+            });
+            gl.deleteVertexArray(renderer.lineArray);
+            gl.deleteVertexArray(renderer.dotArray);
+            gl.deleteProgram(renderer.lineProgram);
+            gl.deleteProgram(renderer.dotProgram);
+            Module['renderers'][$0] = null;
+        },
+               renderer->privado.handle);
+        free(renderer);
+    }
+}
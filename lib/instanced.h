@@ -0,0 +1,69 @@
+/**
+ * Draws many lines and many dots on a canvas with one instanced draw call each, through
+ * WebGL2, for programs whose canvas 2D draw calls have become the bottleneck.
+ * @file instanced.h
+ */
+#ifndef INSTANCED_H
+#define INSTANCED_H
+
+#include "canvas.h"
+
+typedef struct InstancedRenderer InstancedRenderer;
+
+/**
+ * Struct containing state and OO-like behavior of an instanced renderer. This struct should be
+ * instantiated using the createInstancedRenderer() function, and, when you're done using it,
+ * should be freed using the freeInstancedRenderer() function.
+ *
+ * Geometry is passed as arrays of float32 instance attributes, which are uploaded to a vertex
+ * buffer as they are and expanded into quads on the GPU. Lines are antialiased across their
+ * width and have butt caps; lines thinner than a pixel are drawn a pixel wide with their
+ * opacity scaled down by their width, the same coverage canvas 2D gives them. Everything is
+ * composited source-over, one instance after another.
+ *
+ * A typical use of this struct might look like the following:
+ *
+ *     InstancedRenderer *renderer = createInstancedRenderer(canvas);
+ *     if (!renderer)
+ *         ... // no WebGL2: draw with canvas->getContext(canvas, "2d") instead
+ *     renderer->beginFrame(renderer, 1920, 1080);
+ *     renderer->drawLines(renderer, lines, lineCount, 1, 1, 1);
+ *     renderer->drawDots(renderer, centers, dotCount, 3, 1, 1, 1);
+ *     freeInstancedRenderer(renderer);
+ *
+ * In a HEADLESS build, the same calls are carried out by the canvas 2D software rasterizer,
+ * one instance at a time, so that a program's output through this renderer can be compared
+ * with its output through the 2D context at the same seed.
+ */
+struct InstancedRenderer
+{
+    struct
+    {
+        HTMLCanvasElement *canvas;
+        /** Index of the renderer's GL state in the JavaScript-side Module['renderers'] table. */
+        int handle;
+        /** The 2D context the HEADLESS build draws through. */
+        CanvasRenderingContext2D *context;
+    } privado;
+    /** Resizes the canvas to width x height if it is not that size, and clears it to transparent. */
+    void (*beginFrame)(InstancedRenderer *that, int width, int height);
+    /**
+     * Draws count lines with one draw call. Each line is 6 floats: x0, y0, x1, y1, width and
+     * opacity, in canvas pixels and [0, 1]. Color components are in [0, 1].
+     */
+    void (*drawLines)(InstancedRenderer *that, float const *lines, int count, float red, float green, float blue);
+    /** Draws count filled circles with one draw call. Each center is 2 floats: x and y. */
+    void (*drawDots)(InstancedRenderer *that, float const *centers, int count, float radius, float red, float green, float blue);
+};
+
+/**
+ * Creates a WebGL2 context on the canvas and compiles the renderer's shaders. Returns NULL if
+ * the browser has no WebGL2 or the canvas already has a 2D context, in which case the caller
+ * should fall back to drawing with canvas 2D.
+ */
+InstancedRenderer *createInstancedRenderer(HTMLCanvasElement *canvas);
+
+/** Frees the struct and its GPU buffers. The canvas is left alone. */
+void freeInstancedRenderer(InstancedRenderer *renderer);
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Implements InstancedRenderer for HEADLESS builds by drawing every instance through the
+ * canvas' software-rasterized 2D context, one stroke or fill per instance, which composites
+ * the same way the GPU's per-instance blending does.
+ * @file instanced_headless.c
+ */
+
+#include "instanced.h"
+#include <stdio.h>
+#include <math.h>
+
+static void setColor(char *style, float red, float green, float blue, float alpha)
+{
+    sprintf(style, "rgba(%d, %d, %d, %f)", (int)lroundf(red * 255), (int)lroundf(green * 255), (int)lroundf(blue * 255), alpha);
+}
+
+/* Begin: InstancedRenderer static methods */
+static void instanced_beginFrame(InstancedRenderer *that, int width, int height)
+{
+    HTMLCanvasElement *canvas = that->privado.canvas;
+    if (canvas->getWidth(canvas) != width)
+        canvas->setWidth(canvas, width);
+    if (canvas->getHeight(canvas) != height)
+        canvas->setHeight(canvas, height);
+    that->privado.context->clearRect(that->privado.context, 0, 0, width, height);
+}
+static void instanced_drawLines(InstancedRenderer *that, float const *lines, int count, float red, float green, float blue)
+{
+    CanvasRenderingContext2D *ctx = that->privado.context;
+    char style[64];
+    float opacity = -1;
+    for (int i = 0; i < count; ++i, lines += 6)
+    {
+        if (lines[5] != opacity)
+        {
+            opacity = lines[5];
+            setColor(style, red, green, blue, opacity);
+            ctx->setStrokeStyle(ctx, style);
+        }
+        ctx->setLineWidth(ctx, lines[4]);
+        ctx->beginPath(ctx);
+        ctx->moveTo(ctx, lines[0], lines[1]);
+        ctx->lineTo(ctx, lines[2], lines[3]);
+        ctx->stroke(ctx);
+    }
+}
+static void instanced_drawDots(InstancedRenderer *that, float const *centers, int count, float radius, float red, float green, float blue)
+{
+    CanvasRenderingContext2D *ctx = that->privado.context;
+    char style[64];
+    setColor(style, red, green, blue, 1);
+    ctx->setFillStyle(ctx, style);
+    for (int i = 0; i < count; ++i, centers += 2)
+    {
+        ctx->beginPath(ctx);
+        ctx->arc(ctx, centers[0], centers[1], radius, 0, 2 * M_PI);
+        ctx->fill(ctx);
+    }
+}
+/* End: InstancedRenderer static methods */
+
+InstancedRenderer *createInstancedRenderer(HTMLCanvasElement *canvas)
+{
+    CanvasRenderingContext2D *ctx = canvas->getContext(canvas, "2d");
+    if (!ctx)
+        return NULL;
+    InstancedRenderer *r = (InstancedRenderer *)malloc(sizeof(InstancedRenderer));
+    /* Begin: set pseudo-privado fields */
+    r->privado.canvas = canvas;
+    r->privado.handle = -1;
+    r->privado.context = ctx;
+    /* End: set pseudo-privado fields */
+    r->beginFrame = instanced_beginFrame;
+    r->drawLines = instanced_drawLines;
+    r->drawDots = instanced_drawDots;
+    return r;
+}
+
+void freeInstancedRenderer(InstancedRenderer *renderer)
+{
+    free(renderer);
+}
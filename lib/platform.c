@@ -0,0 +1,111 @@
+/**
+ * The little the program needs from its host besides the canvas and the window.
+ * @file platform.c
+ */
+
+#include "platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HEADLESS
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+void consoleLog(char const *message)
+{
+    fputs(message, stderr);
+    fputc('\n', stderr);
+}
+
+double performanceNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+int hardwareConcurrency()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+char *pageSettings(char const *elementId)
+{
+    return strdup("");
+}
+
+void publishTelemetry(char const *name, char const *json)
+{
+}
+#else
+#include <emscripten.h>
+
+void consoleLog(char const *message)
+{
+    emscripten_console_log(message);
+}
+
+double performanceNow()
+{
+    return emscripten_get_now();
+}
+
+int hardwareConcurrency()
+{
+    int count = EM_ASM_INT({
+        return navigator.hardwareConcurrency || 1;
+    });
+    return count > 0 ? count : 1;
+}
+
+char *pageSettings(char const *elementId)
+{
+    return (char *)MAIN_THREAD_EM_ASM_INT(
+        {
+            var settings = [];
+            var id = UTF8ToString($0);
+            var element = document.getElementById(id);
+            if (element && element.textContent.trim())
+            {
+                try
+                {
+                    var object = JSON.parse(element.textContent);
+                    for (var name in object)
+                        settings.push(encodeURIComponent(name) + "=" + encodeURIComponent(String(object[name])));
+                }
+                catch (error)
+                {
+                    console.error("Ignoring #" + id + ": " + error);
+                }
+            }
+            if (location.search.length > 1)
+                settings.push(location.search.substring(1));
+            var text = settings.join("&");
+            var size = lengthBytesUTF8(text) + 1;
+            var pointer = _malloc(size);
+            stringToUTF8(text, pointer, size);
+            return pointer;
+        },
+        elementId);
+}
+
+void publishTelemetry(char const *name, char const *json)
+{
+    // The page's thread reads the strings after this has returned, so it's handed copies of
+    // them, in one block, which it frees.
+    size_t nameBytes = strlen(name) + 1;
+    size_t jsonBytes = strlen(json) + 1;
+    char *copy = (char *)malloc(nameBytes + jsonBytes);
+    memcpy(copy, name, nameBytes);
+    memcpy(copy + nameBytes, json, jsonBytes);
+    MAIN_THREAD_ASYNC_EM_ASM({
+        var telemetry = Module['telemetry'] = Module['telemetry'] || {};
+        telemetry[UTF8ToString($0)] = JSON.parse(UTF8ToString($1));
+        _free($0);
+    },
+           copy, copy + nameBytes);
+}
+#endif
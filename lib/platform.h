@@ -0,0 +1,46 @@
+/**
+ * The little the program needs from its host besides the canvas and the window: a console,
+ * a clock and the page's settings. In the browser these are JavaScript's; in a HEADLESS
+ * build, the C library's.
+ * @file platform.h
+ */
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+/**
+ * Writes a line to the browser console, or to stderr in a HEADLESS build, which keeps stdout
+ * free for the program's own output.
+ */
+void consoleLog(char const *message);
+
+/**
+ * Returns a timestamp in milliseconds, with sub-millisecond precision, from a monotonic clock
+ * like JavaScript's performance.now(). Only differences between timestamps are meaningful.
+ */
+double performanceNow();
+
+/**
+ * Returns the number of logical processors available to the program, like JavaScript's
+ * navigator.hardwareConcurrency, or 1 if it can't be told.
+ */
+int hardwareConcurrency();
+
+/**
+ * Returns the settings the page was loaded with as one query string, such as
+ * "particles=500&size=2": first the members of the JSON object in the page's element with the
+ * given id, if there is one, then the URL's query string, so that a setting in the URL comes
+ * later. Names and values are percent-encoded. The string is malloc'd; free it when done. It
+ * can be called from any thread. A HEADLESS build has no page, and returns an empty string.
+ */
+char *pageSettings(char const *elementId);
+
+/**
+ * Hands a JSON object to whatever collects the program's telemetry: in the browser it becomes
+ * the page's Module['telemetry'][name], whichever thread publishes it, replacing the last one
+ * published under that name. It doesn't wait for the page's thread to take it, so publishing
+ * from a render thread doesn't hold up drawing. A HEADLESS build has nowhere to send it, and
+ * drops it.
+ */
+void publishTelemetry(char const *name, char const *json);
+
+#endif
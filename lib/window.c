@@ -6,55 +6,136 @@
  */
 
 #include "window.h"
+#include "arena.h"
+#include <emscripten/html5.h>
+
+/*
+ * Only the page's thread has a window and a document, so whatever is read from them is read
+ * there, with MAIN_THREAD_EM_ASM, and events registered for on another thread are forwarded
+ * to it by Emscripten. That call waits for the page's thread, so it's made once, when the
+ * window is created, and the events keep what it read up to date.
+ */
+
+/** The active HTMLWindow. This field facilitates the Singleton design pattern. */
+static HTMLWindow *current;
+static ObjectPool windowPool = OBJECT_POOL_INITIALIZER(HTMLWindow, 1);
+
+/**
+ * The window's sizes as of the last resize event. They're kept here so that reading them
+ * doesn't cross into JavaScript.
+ */
+static int innerWidth, innerHeight, outerWidth, outerHeight;
+
+/** The state listener and its user data. */
+static WindowStateListener stateListener;
+static void *stateUserData;
+
+/** Whether the page was hidden, and whether the window had focus, as of the last event. */
+static int hidden, focused;
 
 /* Begin: HTMLWindow static methods */
 static int window_getInnerHeight()
 {
-    return EM_ASM_INT({
-        return window.innerHeight;
-    });
+    return innerHeight;
 }
 static int window_getInnerWidth()
 {
-    return EM_ASM_INT({
-        return window.innerWidth;
-    });
+    return innerWidth;
 }
 static int window_getOuterHeight()
 {
-    return EM_ASM_INT({
-        return window.outerHeight;
-    });
+    return outerHeight;
 }
 static int window_getOuterWidth()
 {
-    return EM_ASM_INT({
-        return window.outerWidth;
-    });
+    return outerWidth;
 }
 static void window_blur()
 {
-    EM_ASM({
+    MAIN_THREAD_ASYNC_EM_ASM({
         window.blur();
     });
 }
+static int window_isHidden()
+{
+    return hidden;
+}
+static int window_hasFocus()
+{
+    return focused;
+}
+static EM_BOOL onVisibilityChange(int eventType, const EmscriptenVisibilityChangeEvent *event, void *userData)
+{
+    hidden = event->hidden;
+    if (stateListener)
+        stateListener(hidden, focused, stateUserData);
+    return 0;
+}
+static EM_BOOL onFocusChange(int eventType, const EmscriptenFocusEvent *event, void *userData)
+{
+    // document.hasFocus() still answers for the element losing focus during a blur event
+    focused = eventType == EMSCRIPTEN_EVENT_FOCUS;
+    if (stateListener)
+        stateListener(hidden, focused, stateUserData);
+    return 0;
+}
+static EM_BOOL onResize(int eventType, const EmscriptenUiEvent *event, void *userData)
+{
+    innerWidth = event->windowInnerWidth;
+    innerHeight = event->windowInnerHeight;
+    outerWidth = event->windowOuterWidth;
+    outerHeight = event->windowOuterHeight;
+    return 0;
+}
+static void window_setStateListener(WindowStateListener listener, void *userData)
+{
+    stateListener = listener;
+    stateUserData = userData;
+}
 /* End: HTMLWindow static methods */
 
 HTMLWindow *Window()
 {
     if (!current)
     {
-        current = (HTMLWindow *)malloc(sizeof(HTMLWindow));
+        current = (HTMLWindow *)objectPoolTake(&windowPool);
         current->getInnerHeight = window_getInnerHeight;
         current->getInnerWidth = window_getInnerWidth;
         current->getOuterHeight = window_getOuterHeight;
         current->getOuterWidth = window_getOuterWidth;
         current->blur = window_blur;
+        current->isHidden = window_isHidden;
+        current->hasFocus = window_hasFocus;
+        current->setStateListener = window_setStateListener;
+        innerWidth = MAIN_THREAD_EM_ASM_INT({
+            return window.innerWidth;
+        });
+        innerHeight = MAIN_THREAD_EM_ASM_INT({
+            return window.innerHeight;
+        });
+        outerWidth = MAIN_THREAD_EM_ASM_INT({
+            return window.outerWidth;
+        });
+        outerHeight = MAIN_THREAD_EM_ASM_INT({
+            return window.outerHeight;
+        });
+        hidden = MAIN_THREAD_EM_ASM_INT({
+            return document.hidden ? 1 : 0;
+        });
+        focused = MAIN_THREAD_EM_ASM_INT({
+            return document.hasFocus() ? 1 : 0;
+        });
+        emscripten_set_resize_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, 0, onResize);
+        emscripten_set_visibilitychange_callback(NULL, 0, onVisibilityChange);
+        emscripten_set_focus_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, 0, onFocusChange);
+        emscripten_set_blur_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, 0, onFocusChange);
     }
     return current;
 }
 
 void freeWindow(HTMLWindow *window)
 {
-    free(window);
+    if (window == current)
+        current = NULL; // the next Window() makes a new one
+    objectPoolGive(&windowPool, window);
 }
\ No newline at end of file
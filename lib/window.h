@@ -8,13 +8,18 @@
 #ifndef WINDOW_H
 #define WINDOW_H
 
+#ifndef HEADLESS
 #include <emscripten.h>
+#endif
 #include <stdlib.h>
 
 typedef struct HTMLWindow HTMLWindow;
 
-/** The active HTMLWindow. This field facilitates the Singleton design pattern. */
-static HTMLWindow *current;
+/**
+ * Called with whether the page is hidden and whether the window has focus, every time either
+ * changes.
+ */
+typedef void (*WindowStateListener)(int hidden, int focused, void *userData);
 
 /**
  * Struct containing state and OO-like behavior similar to that of the globally available
@@ -35,14 +40,35 @@ static HTMLWindow *current;
  *     canvas->setWidth(canvas, Window()->getInnerWidth());
  *     freeCanvas(canvas);
  *     freeWindow(Window());
+ * 
+ * The window can be used from a thread other than the page's, such as one drawing to a
+ * transferred canvas. Its events are then delivered on the thread that first called Window(),
+ * state listener calls included, and the browser's main thread only forwards them there.
  */
 struct HTMLWindow
 {
+    /**
+     * The window's sizes, which are read once and then kept up to date by resize events, so
+     * that reading them is as cheap as reading a variable.
+     */
     int (*getInnerHeight)();
     int (*getInnerWidth)();
     int (*getOuterHeight)();
     int (*getOuterWidth)();
     void (*blur)();
+    /**
+     * Returns nonzero if the page is hidden, like document.hidden: its tab is in the
+     * background, the window is minimized, or, in some browsers, the window is entirely
+     * covered by others. Like the sizes, it's kept up to date by events, as is hasFocus().
+     */
+    int (*isHidden)();
+    /** Returns nonzero if the window has keyboard focus, like document.hasFocus(). */
+    int (*hasFocus)();
+    /**
+     * Calls listener on visibilitychange events and on the window's focus and blur events.
+     * There is one listener at a time: setting another replaces it, and NULL removes it.
+     */
+    void (*setStateListener)(WindowStateListener listener, void *userData);
 };
 
 /**
@@ -59,4 +85,27 @@ HTMLWindow *Window();
 
 void freeWindow(HTMLWindow *window);
 
+#ifdef HEADLESS
+/**
+ * In a HEADLESS build there is no browser window, so its inner and outer sizes are both
+ * whatever was last set here: 1920x1080 until this is called.
+ */
+void resizeWindow(int width, int height);
+
+/**
+ * Sets whether the HEADLESS window is hidden and has focus, and calls its state listener as a
+ * browser would. It's visible and focused until this is called.
+ */
+void setWindowState(int hidden, int focused);
+
+/**
+ * Like the browser's, the HEADLESS window delivers its events on the thread that set the state
+ * listener. When resizeWindow() or setWindowState() is called on any other thread, the window
+ * only takes the change, and calls the listener, when that thread next calls this, as a
+ * browser would between frames. Only the latest size and the latest state are delivered.
+ * Before a listener is set, changes are taken right away on any thread.
+ */
+void dispatchWindowEvents();
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+/**
+ * Stands in for the browser window in HEADLESS builds, where there is none.
+ * @file window_headless.c
+ */
+
+#include "window.h"
+#include "arena.h"
+#include <pthread.h>
+
+/** The active HTMLWindow. This field facilitates the Singleton design pattern. */
+static HTMLWindow *current;
+static ObjectPool windowPool = OBJECT_POOL_INITIALIZER(HTMLWindow, 1);
+
+static int innerWidth = 1920;
+static int innerHeight = 1080;
+static int hidden = 0;
+static int focused = 1;
+static WindowStateListener stateListener;
+static void *stateUserData;
+
+/**
+ * The thread that set the listener, and the latest size and state set on any other thread,
+ * waiting for it to call dispatchWindowEvents(). The lock guards these and stateListener.
+ */
+static pthread_mutex_t eventLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t listenerThread;
+static int resizePending, pendingWidth, pendingHeight;
+static int statePending, pendingHidden, pendingFocused;
+
+/** Whether an event raised on this thread has to wait for the listener's. Call with the lock held. */
+static int mustForward()
+{
+    return stateListener && !pthread_equal(pthread_self(), listenerThread);
+}
+
+/* Begin: HTMLWindow static methods */
+static int window_getInnerHeight()
+{
+    return innerHeight;
+}
+static int window_getInnerWidth()
+{
+    return innerWidth;
+}
+static int window_getOuterHeight()
+{
+    return innerHeight;
+}
+static int window_getOuterWidth()
+{
+    return innerWidth;
+}
+static void window_blur()
+{
+}
+static int window_isHidden()
+{
+    return hidden;
+}
+static int window_hasFocus()
+{
+    return focused;
+}
+static void window_setStateListener(WindowStateListener listener, void *userData)
+{
+    pthread_mutex_lock(&eventLock);
+    stateListener = listener;
+    stateUserData = userData;
+    listenerThread = pthread_self();
+    pthread_mutex_unlock(&eventLock);
+}
+/* End: HTMLWindow static methods */
+
+HTMLWindow *Window()
+{
+    if (!current)
+    {
+        current = (HTMLWindow *)objectPoolTake(&windowPool);
+        current->getInnerHeight = window_getInnerHeight;
+        current->getInnerWidth = window_getInnerWidth;
+        current->getOuterHeight = window_getOuterHeight;
+        current->getOuterWidth = window_getOuterWidth;
+        current->blur = window_blur;
+        current->isHidden = window_isHidden;
+        current->hasFocus = window_hasFocus;
+        current->setStateListener = window_setStateListener;
+    }
+    return current;
+}
+
+void freeWindow(HTMLWindow *window)
+{
+    if (window == current)
+        current = NULL; // the next Window() makes a new one
+    objectPoolGive(&windowPool, window);
+}
+
+void resizeWindow(int width, int height)
+{
+    pthread_mutex_lock(&eventLock);
+    if (mustForward())
+    {
+        resizePending = 1;
+        pendingWidth = width;
+        pendingHeight = height;
+        pthread_mutex_unlock(&eventLock);
+        return;
+    }
+    pthread_mutex_unlock(&eventLock);
+    innerWidth = width;
+    innerHeight = height;
+}
+
+void setWindowState(int isHidden, int hasFocus)
+{
+    pthread_mutex_lock(&eventLock);
+    if (mustForward())
+    {
+        statePending = 1;
+        pendingHidden = isHidden;
+        pendingFocused = hasFocus;
+        pthread_mutex_unlock(&eventLock);
+        return;
+    }
+    WindowStateListener listener = stateListener;
+    pthread_mutex_unlock(&eventLock);
+    hidden = isHidden;
+    focused = hasFocus;
+    if (listener)
+        listener(hidden, focused, stateUserData);
+}
+
+void dispatchWindowEvents()
+{
+    pthread_mutex_lock(&eventLock);
+    int resized = resizePending, changed = statePending;
+    int width = pendingWidth, height = pendingHeight, isHidden = pendingHidden, hasFocus = pendingFocused;
+    resizePending = statePending = 0;
+    pthread_mutex_unlock(&eventLock);
+    // this is the listener's thread, so these take effect right away
+    if (resized)
+        resizeWindow(width, height);
+    if (changed)
+        setWindowState(isHidden, hasFocus);
+}
@@ -0,0 +1,126 @@
+#include <math.h>  // lround, fmin, isfinite
+#include <stdio.h>  // snprintf
+#include <stdlib.h>  // strtod, strtol, malloc, free
+#include <string.h>  // strcmp, strlen
+#include "config.h"
+#include "platform.h"  // consoleLog
+
+// The defaults: 115 particles on a 1920x1080 canvas, 3 pixels across, with
+// lines between the ones closer than 250 pixels.
+#define DEFAULT_PARTICLE_DENSITY (115 * 1e6 / (1920 * 1080))
+#define DEFAULT_PARTICLE_SIZE 3
+#define DEFAULT_THRESHOLD 250.0
+#define DEFAULT_SPEED_MULTIPLIER 2.5
+// The most particles there can be, whether they're set or come from the
+// density; at most 10,000 particles in a million square pixels, close to 200
+// times the default; and lines between particles from 1 to 100,000 pixels
+// apart. Past these, the arrays the particles and their pairs take outgrow
+// the memory there is.
+#define MAX_PARTICLES 1e7
+#define MAX_PARTICLE_DENSITY 1e4
+#define MIN_THRESHOLD 1.0
+#define MAX_THRESHOLD 1e5
+// The browser build keeps frames to 12 ms, well inside a 60 Hz refresh. The
+// native build's frames are for comparing and timing, so it leaves them be.
+#ifdef HEADLESS
+#define DEFAULT_FRAME_BUDGET 0
+#else
+#define DEFAULT_FRAME_BUDGET 12
+#endif
+
+
+void config_init(struct Config *config) {
+	config->particle_count = 0;
+	config->particle_density = DEFAULT_PARTICLE_DENSITY;
+	config->particle_size = DEFAULT_PARTICLE_SIZE;
+	config->threshold = DEFAULT_THRESHOLD;
+	config->speed_multiplier = DEFAULT_SPEED_MULTIPLIER;
+	config->frame_budget = DEFAULT_FRAME_BUDGET;
+}
+
+
+// Reads the whole of text as a number. Returns 0, or -1 if it isn't one.
+static int parse_number(char const *text, double *number) {
+	char *end;
+	*number = strtod(text, &end);
+	return end == text || *end != '\0' || !isfinite(*number) ? -1 : 0;
+}
+
+
+int config_set(struct Config *config, char const *name, char const *value) {
+	double number;
+	if (parse_number(value, &number) != 0) {
+		return -1;
+	}
+	if (strcmp(name, "particles") == 0 && number >= 0 && number <= MAX_PARTICLES && number == (int)number) {
+		config->particle_count = (int)number;
+	} else if (strcmp(name, "density") == 0 && number > 0 && number <= MAX_PARTICLE_DENSITY) {
+		config->particle_density = number;
+	} else if (strcmp(name, "size") == 0 && number > 0) {
+		config->particle_size = number;
+	} else if (strcmp(name, "threshold") == 0 && number >= MIN_THRESHOLD && number <= MAX_THRESHOLD) {
+		config->threshold = number;
+	} else if (strcmp(name, "speed") == 0 && number >= 0) {
+		config->speed_multiplier = number;
+	} else if (strcmp(name, "budget") == 0 && number >= 0) {
+		config->frame_budget = number;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+
+static int hex_digit(char c) {
+	return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+
+// Decodes the percent-encoded text from start up to end into out, which has
+// room for it.
+static void decode(char const *start, char const *end, char *out) {
+	while (start < end) {
+		if (*start == '+') {
+			*out++ = ' ';
+			++start;
+		} else if (*start == '%' && end - start >= 3 && hex_digit(start[1]) >= 0 && hex_digit(start[2]) >= 0) {
+			*out++ = (char)(hex_digit(start[1]) * 16 + hex_digit(start[2]));
+			start += 3;
+		} else {
+			*out++ = *start++;
+		}
+	}
+	*out = '\0';
+}
+
+
+void config_set_query(struct Config *config, char const *query) {
+	char *name = malloc(strlen(query) + 1);
+	char *value = malloc(strlen(query) + 1);
+	while (*query) {
+		char const *end = strchr(query, '&');
+		end = end ? end : query + strlen(query);
+		char const *equals = memchr(query, '=', end - query);
+		if (end > query) {
+			decode(query, equals ? equals : end, name);
+			decode(equals ? equals + 1 : end, end, value);
+			if (config_set(config, name, value) != 0) {
+				char message[160];
+				snprintf(message, sizeof(message), "Ignoring the setting %.60s=%.60s", name, value);
+				consoleLog(message);
+			}
+		}
+		query = *end ? end + 1 : end;
+	}
+	free(name);
+	free(value);
+}
+
+
+int config_particle_count(struct Config const *config, int width, int height) {
+	if (config->particle_count > 0) {
+		return config->particle_count;
+	}
+	double count = config->particle_density * width / 1e6 * height;
+	return count > 1 ? (int)lround(fmin(count, MAX_PARTICLES)) : 1;
+}
@@ -0,0 +1,50 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// What the program can be tuned with when it starts, without a rebuild. The
+// native build takes the settings from its arguments; the browser build from
+// the query string of the page's URL and from a JSON object in the page:
+//
+//     <script type="application/json" id="config">{"threshold": 200}</script>
+//
+// with the URL's winning. Each setting is a name and a value:
+//
+//     particles   how many particles, up to 10,000,000; 0, the default,
+//                 scales the count with the canvas' area to keep `density`
+//                 particles in every million square pixels, up to the same
+//     density     115 particles for a 1920x1080 canvas by default, and at
+//                 most 10,000 in every million square pixels
+//     size        the particles' radius, and the widest a line gets
+//     threshold   how close two particles have to be to get a line, from 1
+//                 to 100,000 pixels
+//     speed       how fast the particles move, relative to the default
+//     budget      the most milliseconds a frame, or the simulation step it
+//                 draws, should take; past it, fewer particles are drawn
+//                 (see quality.h). 0 turns that off, which is the native
+//                 build's default
+struct Config {
+	int particle_count;
+	double particle_density;
+	double particle_size;
+	double threshold;
+	double speed_multiplier;
+	double frame_budget;
+};
+
+void config_init(struct Config *config);
+
+// Sets a setting from its name and value. Returns 0, or -1, leaving it as it
+// was, if there is no such setting or the value is not a valid one for it.
+int config_set(struct Config *config, char const *name, char const *value);
+
+// Sets every name=value in a query string, such as "particles=500&size=2",
+// with its names and values percent-encoded. Logs the ones it can't set to
+// the console and carries on.
+void config_set_query(struct Config *config, char const *query);
+
+// How many particles a width x height canvas gets: particle_count, or, if
+// that's 0, as many as the density gives the area, at least one and at most
+// 10,000,000.
+int config_particle_count(struct Config const *config, int width, int height);
+
+#endif
@@ -0,0 +1,328 @@
+#include <math.h>  // floor, fmin, fmax, fabs
+#include <stdlib.h>  // realloc, free
+#include <string.h>  // memset
+#include "dirty.h"
+
+
+void dirty_init(struct Dirty *dirty, int tile_size) {
+	dirty->tile_size = tile_size;
+	dirty->width = 0;
+	dirty->height = 0;
+	dirty->columns = 0;
+	dirty->rows = 0;
+	dirty->tiles = NULL;
+	dirty->tile_capacity = 0;
+	dirty->marked = 0;
+	dirty->rects = NULL;
+	dirty->rect_count = 0;
+	dirty->rect_capacity = 0;
+}
+
+
+void dirty_free(struct Dirty *dirty) {
+	free(dirty->tiles);
+	free(dirty->rects);
+	dirty_init(dirty, dirty->tile_size);
+}
+
+
+void shown_init(struct Shown *shown, double tolerance, double dot_reach, double const *line_reaches) {
+	shown->tolerance = tolerance;
+	shown->dot_reach = dot_reach;
+	shown->line_reaches = line_reaches;
+	shown->count = 0;
+	shown->x = NULL;
+	shown->y = NULL;
+	shown->line_count = 0;
+	shown->lines = NULL;
+	arenaInit(&shown->arenas[0], 0);
+	arenaInit(&shown->arenas[1], 0);
+	shown->current = 0;
+}
+
+
+void shown_free(struct Shown *shown) {
+	arenaFree(&shown->arenas[0]);
+	arenaFree(&shown->arenas[1]);
+	shown_init(shown, shown->tolerance, shown->dot_reach, shown->line_reaches);
+}
+
+
+void dirty_begin(struct Dirty *dirty, int width, int height) {
+	dirty->width = width > 0 ? width : 0;
+	dirty->height = height > 0 ? height : 0;
+	dirty->columns = (dirty->width + dirty->tile_size - 1) / dirty->tile_size;
+	dirty->rows = (dirty->height + dirty->tile_size - 1) / dirty->tile_size;
+	int tile_count = dirty->columns * dirty->rows;
+	if (tile_count > dirty->tile_capacity) {
+		dirty->tile_capacity = tile_count;
+		dirty->tiles = realloc(dirty->tiles, tile_count);
+	}
+	if (tile_count > 0) {
+		memset(dirty->tiles, 0, tile_count);
+	}
+	dirty->marked = 0;
+	dirty->rect_count = 0;
+}
+
+
+void dirty_mark_all(struct Dirty *dirty) {
+	int tile_count = dirty->columns * dirty->rows;
+	if (tile_count > 0) {
+		memset(dirty->tiles, 1, tile_count);
+	}
+	dirty->marked = tile_count;
+}
+
+
+static int clamp(int value, int low, int high) {
+	return value < low ? low : value > high ? high : value;
+}
+
+
+// The first and last tile rows or columns that the span from low to high
+// reaches. Returns 0 if it misses them all.
+static int tile_range(struct Dirty const *dirty, double low, double high, int count, int *first, int *last) {
+	if (high < 0 || low >= (double)count * dirty->tile_size || count == 0) {
+		return 0;
+	}
+	*first = clamp((int)floor(low / dirty->tile_size), 0, count - 1);
+	*last = clamp((int)floor(high / dirty->tile_size), 0, count - 1);
+	return 1;
+}
+
+
+// The columns of tile row `row` within pad of the segment: the part of the
+// segment whose y is within pad of the row, widened by pad on either side.
+static int segment_columns(struct Dirty const *dirty, int row, double x0, double y0, double x1, double y1, double pad,
+		int *first, int *last) {
+	double top = (double)row * dirty->tile_size - pad;
+	double bottom = (double)(row + 1) * dirty->tile_size + pad;
+	double t0 = 0, t1 = 1;
+	double dy = y1 - y0;
+	if (dy != 0) {
+		double ta = (top - y0) / dy;
+		double tb = (bottom - y0) / dy;
+		t0 = fmax(fmin(ta, tb), 0);
+		t1 = fmin(fmax(ta, tb), 1);
+		if (t0 > t1) {
+			return 0;
+		}
+	} else if (y0 < top || y0 > bottom) {
+		return 0;
+	}
+	double xa = x0 + (x1 - x0) * t0;
+	double xb = x0 + (x1 - x0) * t1;
+	return tile_range(dirty, fmin(xa, xb) - pad, fmax(xa, xb) + pad, dirty->columns, first, last);
+}
+
+
+void dirty_mark_rect(struct Dirty *dirty, double x0, double y0, double x1, double y1, double pad) {
+	int first_row, last_row, first_column, last_column;
+	if (!tile_range(dirty, fmin(y0, y1) - pad, fmax(y0, y1) + pad, dirty->rows, &first_row, &last_row)
+			|| !tile_range(dirty, fmin(x0, x1) - pad, fmax(x0, x1) + pad, dirty->columns, &first_column, &last_column)) {
+		return;
+	}
+	for (int row = first_row; row <= last_row; ++row) {
+		unsigned char *tile = dirty->tiles + row * dirty->columns;
+		for (int column = first_column; column <= last_column; ++column) {
+			dirty->marked += !tile[column];
+			tile[column] = 1;
+		}
+	}
+}
+
+
+void dirty_mark_segment(struct Dirty *dirty, double x0, double y0, double x1, double y1, double pad) {
+	int first_row, last_row, first_column, last_column;
+	if (!tile_range(dirty, fmin(y0, y1) - pad, fmax(y0, y1) + pad, dirty->rows, &first_row, &last_row)) {
+		return;
+	}
+	for (int row = first_row; row <= last_row; ++row) {
+		if (!segment_columns(dirty, row, x0, y0, x1, y1, pad, &first_column, &last_column)) {
+			continue;
+		}
+		unsigned char *tile = dirty->tiles + row * dirty->columns;
+		for (int column = first_column; column <= last_column; ++column) {
+			dirty->marked += !tile[column];
+			tile[column] = 1;
+		}
+	}
+}
+
+
+// Whether any tile from first to last in the row is marked.
+static int row_touched(struct Dirty const *dirty, int row, int first, int last) {
+	unsigned char const *tile = dirty->tiles + row * dirty->columns;
+	for (int column = first; column <= last; ++column) {
+		if (tile[column]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+int dirty_touches_rect(struct Dirty const *dirty, double x0, double y0, double x1, double y1, double pad) {
+	int first_row, last_row, first_column, last_column;
+	if (dirty->marked == 0
+			|| !tile_range(dirty, fmin(y0, y1) - pad, fmax(y0, y1) + pad, dirty->rows, &first_row, &last_row)
+			|| !tile_range(dirty, fmin(x0, x1) - pad, fmax(x0, x1) + pad, dirty->columns, &first_column, &last_column)) {
+		return 0;
+	}
+	for (int row = first_row; row <= last_row; ++row) {
+		if (row_touched(dirty, row, first_column, last_column)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+int dirty_touches_segment(struct Dirty const *dirty, double x0, double y0, double x1, double y1, double pad) {
+	int first_row, last_row, first_column, last_column;
+	if (dirty->marked == 0
+			|| !tile_range(dirty, fmin(y0, y1) - pad, fmax(y0, y1) + pad, dirty->rows, &first_row, &last_row)) {
+		return 0;
+	}
+	for (int row = first_row; row <= last_row; ++row) {
+		if (segment_columns(dirty, row, x0, y0, x1, y1, pad, &first_column, &last_column)
+				&& row_touched(dirty, row, first_column, last_column)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+void dirty_mark_changes(struct Dirty *dirty, struct Shown *shown, int full, int count, coord const *x, coord const *y,
+		struct Pairs const *pairs, int const *pair_levels) {
+	Arena *arena = &shown->arenas[!shown->current];
+	arenaReset(arena);
+	unsigned char *moved = arenaAlloc(arena, count);
+	full = full || shown->count != count;
+	if (full) {
+		dirty_mark_all(dirty);
+		for (int i = 0; i < count; ++i) {
+			moved[i] = 1;
+		}
+	} else {
+		for (int i = 0; i < count; ++i) {
+			moved[i] = fabs(x[i] - shown->x[i]) > shown->tolerance || fabs(y[i] - shown->y[i]) > shown->tolerance;
+			if (moved[i]) {
+				dirty_mark_rect(dirty, shown->x[i], shown->y[i], shown->x[i], shown->y[i], shown->dot_reach);
+				dirty_mark_rect(dirty, x[i], y[i], x[i], y[i], shown->dot_reach);
+			}
+		}
+		int old = 0;
+		for (int k = 0; k <= pairs->count; ++k) {
+			struct Pair const *pair = k < pairs->count ? &pairs->items[k] : NULL;
+			// Lines that are gone, up to this one.
+			for (; old < shown->line_count && (!pair || shown->lines[old].i < pair->i
+					|| shown->lines[old].i == pair->i && shown->lines[old].j < pair->j); ++old) {
+				struct ShownLine const *line = &shown->lines[old];
+				dirty_mark_segment(dirty, shown->x[line->i], shown->y[line->i], shown->x[line->j], shown->y[line->j],
+					shown->line_reaches[line->level]);
+			}
+			if (!pair) {
+				break;
+			}
+			int kept = old < shown->line_count && shown->lines[old].i == pair->i && shown->lines[old].j == pair->j;
+			if (kept && shown->lines[old].level == pair_levels[k] && !moved[pair->i] && !moved[pair->j]) {
+				++old;
+				continue;
+			}
+			if (kept) {
+				struct ShownLine const *line = &shown->lines[old++];
+				dirty_mark_segment(dirty, shown->x[line->i], shown->y[line->i], shown->x[line->j], shown->y[line->j],
+					shown->line_reaches[line->level]);
+			}
+			coord x0 = moved[pair->i] ? x[pair->i] : shown->x[pair->i];
+			coord y0 = moved[pair->i] ? y[pair->i] : shown->y[pair->i];
+			coord x1 = moved[pair->j] ? x[pair->j] : shown->x[pair->j];
+			coord y1 = moved[pair->j] ? y[pair->j] : shown->y[pair->j];
+			dirty_mark_segment(dirty, x0, y0, x1, y1, shown->line_reaches[pair_levels[k]]);
+		}
+	}
+
+	coord *shown_x = arenaAlloc(arena, count * sizeof(coord));
+	coord *shown_y = arenaAlloc(arena, count * sizeof(coord));
+	for (int i = 0; i < count; ++i) {
+		shown_x[i] = moved[i] ? x[i] : shown->x[i];
+		shown_y[i] = moved[i] ? y[i] : shown->y[i];
+	}
+	struct ShownLine *lines = arenaAlloc(arena, pairs->count * sizeof(struct ShownLine));
+	for (int k = 0; k < pairs->count; ++k) {
+		lines[k] = (struct ShownLine){pairs->items[k].i, pairs->items[k].j, pair_levels[k]};
+	}
+	shown->count = count;
+	shown->x = shown_x;
+	shown->y = shown_y;
+	shown->line_count = pairs->count;
+	shown->lines = lines;
+	shown->current = !shown->current;
+}
+
+
+static void add_rect(struct Dirty *dirty, int x, int y, int width, int height) {
+	if (dirty->rect_count == dirty->rect_capacity) {
+		dirty->rect_capacity = dirty->rect_capacity ? dirty->rect_capacity * 2 : 16;
+		dirty->rects = realloc(dirty->rects, dirty->rect_capacity * sizeof(struct DirtyRect));
+	}
+	dirty->rects[dirty->rect_count++] = (struct DirtyRect){x, y, width, height};
+}
+
+
+void dirty_end(struct Dirty *dirty) {
+	dirty->rect_count = 0;
+	if (dirty->marked == 0) {
+		return;
+	}
+	// Each run of marked tiles in a row becomes a rectangle, unless the row
+	// above had a run with the same columns, whose rectangle grows instead.
+	// Rectangles of the row above start at rows_start.
+	int size = dirty->tile_size;
+	int rows_start = 0;
+	for (int row = 0; row < dirty->rows; ++row) {
+		int row_start = dirty->rect_count;
+		unsigned char const *tile = dirty->tiles + row * dirty->columns;
+		int y = row * size;
+		int height = (row + 1) * size <= dirty->height ? size : dirty->height - y;
+		for (int column = 0; column < dirty->columns; ++column) {
+			if (!tile[column]) {
+				continue;
+			}
+			int end = column;
+			while (end + 1 < dirty->columns && tile[end + 1]) {
+				++end;
+			}
+			int x = column * size;
+			int width = ((end + 1) * size <= dirty->width ? (end + 1) * size : dirty->width) - x;
+			int grown = 0;
+			for (int r = rows_start; r < row_start; ++r) {
+				struct DirtyRect *above = &dirty->rects[r];
+				if (above->x == x && above->width == width && above->y + above->height == y) {
+					above->height += height;
+					// keep it among the rectangles that can grow into the next row
+					struct DirtyRect moved = *above;
+					*above = dirty->rects[row_start - 1];
+					dirty->rects[row_start - 1] = moved;
+					--row_start;
+					grown = 1;
+					break;
+				}
+			}
+			if (!grown) {
+				add_rect(dirty, x, y, width, height);
+			}
+			column = end;
+		}
+		rows_start = row_start;
+	}
+}
+
+
+double dirty_fraction(struct Dirty const *dirty) {
+	int tile_count = dirty->columns * dirty->rows;
+	return tile_count ? (double)dirty->marked / tile_count : 0;
+}
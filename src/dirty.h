@@ -0,0 +1,119 @@
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include "arena.h"  // Arena
+#include "pairs.h"  // Pair, Pairs
+#include "particles.h"  // coord
+
+// The parts of a canvas that have to be redrawn this frame, as a grid of
+// square tiles. Whatever changed is marked, with enough padding to cover its
+// antialiased edge, before and after it changed; then the marked tiles are
+// merged into rectangles to clip the redraw to:
+//
+//     dirty_begin(&dirty, width, height);
+//     dirty_mark_segment(&dirty, x0, y0, x1, y1, pad);  // where it was
+//     dirty_mark_segment(&dirty, x2, y2, x3, y3, pad);  // where it is
+//     dirty_end(&dirty);
+//     for (int r = 0; r < dirty.rect_count; ++r)
+//         ... // clip to dirty.rects[r]
+//     // redraw whatever dirty_touches_segment() or _rect() says reaches them
+//
+// Marking and testing are conservative: a tile may be marked, or a shape
+// said to reach one, when it only comes close.
+//
+// dirty_mark_changes() does the marking for a layer that keeps the last frame
+// drawn on it, given what it shows; see struct Shown.
+struct DirtyRect {
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+struct Dirty {
+	int tile_size;
+	int width;
+	int height;
+	int columns;
+	int rows;
+	// One byte per tile, row by row: 1 if it has to be redrawn.
+	unsigned char *tiles;
+	int tile_capacity;
+	int marked;
+	// Set by dirty_end(): the marked tiles as rectangles of canvas pixels,
+	// clipped to the canvas, which don't overlap.
+	struct DirtyRect *rects;
+	int rect_count;
+	int rect_capacity;
+};
+
+// A line drawn on the layer: between which particles, and at which level.
+struct ShownLine {
+	int i;
+	int j;
+	int level;
+};
+
+// What a layer shows: where each particle, and between which particles and
+// at which level each line, was last drawn on it.
+struct Shown {
+	// How far a particle has to move, in x or y, before it's drawn where it
+	// is; until then it, and its lines, stay where they are shown. And how
+	// far past a particle, and past a line of each level, its antialiased
+	// edge can reach, in pixels.
+	double tolerance;
+	double dot_reach;
+	double const *line_reaches;
+	int count;
+	coord *x;
+	coord *y;
+	int line_count;
+	struct ShownLine *lines;
+	// Each frame's arrays are built in one arena from the last frame's in
+	// the other, and then the two swap, so once the arenas have grown to fit
+	// the frames nothing is allocated.
+	Arena arenas[2];
+	int current;
+};
+
+void dirty_init(struct Dirty *dirty, int tile_size);
+
+void dirty_free(struct Dirty *dirty);
+
+void shown_init(struct Shown *shown, double tolerance, double dot_reach, double const *line_reaches);
+
+void shown_free(struct Shown *shown);
+
+// Sizes the tiles to cover a width x height canvas and unmarks them all.
+void dirty_begin(struct Dirty *dirty, int width, int height);
+
+void dirty_mark_all(struct Dirty *dirty);
+
+// Marks the tiles within pad of the rectangle from (x0, y0) to (x1, y1).
+void dirty_mark_rect(struct Dirty *dirty, double x0, double y0, double x1, double y1, double pad);
+
+// Marks the tiles within pad of the segment from (x0, y0) to (x1, y1).
+void dirty_mark_segment(struct Dirty *dirty, double x0, double y0, double x1, double y1, double pad);
+
+// Marks the tiles that change when the layer goes from what shown says it
+// shows to the count particles at x and y, with a line for every pair at
+// its level in pair_levels, and updates shown to match. A particle that
+// moved is marked where it was and where it is; so is a line that appeared,
+// disappeared, changed level, or has a particle that moved. Given full, or a
+// different number of particles than shown, marks everything. Lines are
+// matched up by their particles, since the pair search lists them in order.
+// shown's arrays stay valid until the call after next.
+void dirty_mark_changes(struct Dirty *dirty, struct Shown *shown, int full, int count, coord const *x, coord const *y,
+		struct Pairs const *pairs, int const *pair_levels);
+
+// Builds the rectangles from the marked tiles.
+void dirty_end(struct Dirty *dirty);
+
+// Whether any tile within pad of the rectangle or segment is marked.
+int dirty_touches_rect(struct Dirty const *dirty, double x0, double y0, double x1, double y1, double pad);
+int dirty_touches_segment(struct Dirty const *dirty, double x0, double y0, double x1, double y1, double pad);
+
+// The fraction of the canvas' tiles that are marked.
+double dirty_fraction(struct Dirty const *dirty);
+
+#endif
@@ -1,28 +1,185 @@
-#include <math.h>  // pow, sqrt, M_PI
+#include <math.h>  // pow, sqrt, ceil, fmax, INFINITY
 #include <stdlib.h>  // rand, srand, RAND_MAX
 #include <stdio.h>  // sprintf
+#include <string.h>  // strcmp, strcpy
 #include <time.h>  // time
-#include <emscripten/html5.h>  // emscripten_set_main_loop, emscripten_console_log
+#ifndef HEADLESS
+#include <emscripten/html5.h>  // emscripten_set_main_loop, emscripten_pause_main_loop
+#endif
+#include "arena.h"  // Arena, arena*
 #include "canvas.h"  // HTMLCanvasElement, CanvasRenderingContext2D,
                      // createCanvas, freeCanvas
+#include "canvas_stats.h"  // CanvasStats, canvasStats*
+#include "config.h"  // Config, config_*
+#include "dirty.h"  // Dirty, Shown, dirty_*, shown_init
+#include "driver.h"  // FrameTiming, LevelBin
+#include "harness.h"  // harness_*
+#include "instanced.h"  // InstancedRenderer, createInstancedRenderer
+#include "platform.h"  // consoleLog, performanceNow, pageSettings,
+                       // publishTelemetry
 #include "window.h"  // Window, freeWindow
-
-#define PARTICLE_COUNT 115
-#define PARTICLE_SIZE 3
-#define THRESHOLD 250.0
-#define SPEED_MULTIPLIER 2.5
-
-struct Particle {
-	double x;
-	double y;
-	double vx;
-	double vy;
-};
-
-
+#include "pairs.h"  // Pair
+#include "particles.h"  // Particles, particles_*
+#include "pool.h"  // Pool, pool_*
+#include "power.h"  // Power, PowerState, power_*
+#include "quality.h"  // Quality, QualityReport, quality_*
+#include "render_thread.h"  // RenderThread, render_thread_*
+#include "simulation.h"  // Simulation, Snapshot, simulation_*
+
+// The particles' count, size, speed and line threshold are in config, which
+// the page or the command line can change; see config.h.
+// How many times a second the particles are stepped, whatever the display's
+// refresh rate. Frames drawn between steps show the particles part of the
+// way from one to the next. Speeds are in pixels per 1/60 second, so this
+// changes how smoothly the particles move, not how fast.
+#define SIMULATION_RATE 60
+// Draw at most this many frames a second, skipping display refreshes that
+// come sooner, to save power on fast displays. 0 draws on every refresh.
+#define RENDER_RATE_CAP 0
+// The same while the page is visible but the window doesn't have focus, and
+// while the page is hidden. POWER_PAUSED stops drawing, and the browser
+// build's main loop, until the page is shown again; the particles then carry
+// on from where they stopped.
+#define UNFOCUSED_RENDER_RATE 30
+#define HIDDEN_RENDER_RATE POWER_PAUSED
+// Lines are drawn at one of this many evenly spaced opacities between 0 and
+// the particle size, past which their width stops growing. Each level is a
+// (line width, stroke style) bucket whose lines are all stroked as one path.
+#define LINE_LEVELS 64
+
+// Draw with one WebGL2 instanced call for all the lines and one for all the
+// particles when the browser supports it, falling back to canvas 2D when it
+// doesn't. The native build draws with canvas 2D unless it's given -g.
+#define INSTANCED_RENDERER 1
+// When drawing with canvas 2D, keep the frame on an offscreen layer and only
+// redraw the parts of it where a line or particle changed since the last
+// frame, then copy those to the canvas. A particle only counts as moved once
+// it is more than INCREMENTAL_TOLERANCE pixels, in x or y, from where it was
+// last drawn; until then it, and its lines, stay where they are. The native
+// build only draws this way when it's given -I tolerance.
+#define INCREMENTAL_RENDERING 0
+#define INCREMENTAL_TOLERANCE 0.25
+// The size of the squares the incremental mode tracks changes in, in pixels.
+#define DIRTY_TILE_SIZE 32
+// Publish the quality controller's report as telemetry every this many
+// frames, as well as whenever its level changes.
+#define QUALITY_TELEMETRY_INTERVAL 60
+// Step the simulation and find the pairs on a thread of their own, so their
+// cost never shows up on the thread that draws. The browser build only has
+// threads when it's compiled with -pthread. The native build only uses one
+// when it's given -T, since without it every frame is deterministic.
+#define SIMULATION_THREAD 1
+// Draw on a thread of our own, to the canvas through an OffscreenCanvas, so
+// that neither drawing nor simulating ever holds up the page. The page's
+// thread then only forwards the window's resize and visibility events. Takes
+// threads and a browser that can transfer a canvas; without them, or with
+// this 0, the page's thread draws. The native build only uses one when it's
+// given -R.
+#define RENDER_THREAD 1
+// Memory set aside up front for each frame's scratch buffers, in bytes. The
+// frame arena grows when a frame needs more, but the browser build aborts if
+// the heap can't grow, so it's better to find out before the first frame.
+#define FRAME_ARENA_SIZE (256 * 1024)
+// Split the pair search across this many threads, counting the one that
+// steps the simulation. 0 means one per logical processor; 1 keeps it on one
+// thread. The native build takes the count from -p, and uses one otherwise.
+#define PAIR_SEARCH_THREADS 0
+// Record draw calls into the context's command buffer and replay them with
+// one call into JavaScript per frame. Set to 0 to make every call right away.
+#define RECORD_DRAW_CALLS 1
+// Log the average frame time to the console every this many frames, to
+// compare the two modes above. 0 disables it.
+#define FRAME_TIME_LOG_INTERVAL 0
+// When the canvas library is built with CANVAS_STATS, the previous frame's
+// canvas calls are counted in an overlay. Set this to 1 to time them, too.
+#define CANVAS_STATS_TIMING 0
+
+struct Config config;
+int particle_count;
 HTMLCanvasElement *canvas;
 CanvasRenderingContext2D *context;
-struct Particle particles[PARTICLE_COUNT];
+// Set instead of context when drawing with the instanced renderer.
+InstancedRenderer *renderer;
+#ifdef HEADLESS
+int use_instanced_renderer = 0;
+int use_incremental_rendering = 0;
+int use_simulation_thread = 0;
+int pair_search_threads = 1;
+// The native build draws each frame 1/display_rate seconds after the last on
+// a clock of its own, so frames come out the same however long they take.
+double display_rate = 60;
+unsigned long frames_started = 0;
+// Set to draw each frame at the time it's drawn instead.
+int real_time_frames = 0;
+int use_render_thread = 0;
+#else
+int use_instanced_renderer = INSTANCED_RENDERER;
+int use_incremental_rendering = INCREMENTAL_RENDERING;
+int use_simulation_thread = SIMULATION_THREAD;
+int pair_search_threads = PAIR_SEARCH_THREADS;
+int use_render_thread = RENDER_THREAD;
+#endif
+double simulation_rate = SIMULATION_RATE;
+double render_rate_cap = RENDER_RATE_CAP;
+double incremental_tolerance = INCREMENTAL_TOLERANCE;
+// Which display refreshes get a frame, given whether the page is visible and
+// focused, and how many frames were drawn in each of those states.
+struct Power power;
+// Draws fewer particles when frames take longer than config.frame_budget.
+struct Quality quality;
+struct Particles particles;
+// Steps the particles and finds their pairs, on a thread of its own when
+// SIMULATION_THREAD is set, and publishes them into snapshots. Each frame
+// draws the newest one.
+struct Simulation simulation;
+struct Pool pair_search_pool;
+struct Snapshot const *snapshot;
+// Sets up and draws, when the browser can hand it the canvas, or when the
+// native build is given -R.
+struct RenderThread render_thread;
+// Memory for what a frame only needs while it's drawn, such as the lines by
+// level; it's all taken back as the next frame starts.
+Arena frame_arena;
+// Where the particles are drawn this frame: snapshot->x and y, or positions
+// blended between them and the step before's.
+coord const *drawn_x;
+coord const *drawn_y;
+// Every distinct stroke style, and which one each level uses. Levels past
+// full opacity differ only in width, so they share a style.
+char line_styles[LINE_LEVELS][32];
+int line_style_count;
+char const *line_style_of_level[LINE_LEVELS];
+double line_widths[LINE_LEVELS];
+double line_opacities[LINE_LEVELS];
+// How far past a line of each level its antialiased edge can reach, in
+// pixels. Lines thinner than a pixel are drawn a pixel wide.
+double line_reaches[LINE_LEVELS];
+// The level of every line, by squared distance; see build_level_bins().
+struct LevelBin *level_bins;
+int level_bin_count;
+double level_bin_scale;
+// The lines at level l are snapshot->pairs.items[lines_by_level[level_start[l]]] up to
+// (not including) snapshot->pairs.items[lines_by_level[level_start[l + 1]]].
+int level_start[LINE_LEVELS + 1];
+int *lines_by_level;
+int *pair_levels;
+// The level each line is drawn at this frame, or -1 if it isn't.
+int *line_buckets;
+struct FrameTiming last_frame;
+// The incremental mode's offscreen layer, which always holds the whole
+// frame, and the parts of it the frame being drawn changes.
+HTMLCanvasElement *layer;
+CanvasRenderingContext2D *layer_context;
+struct Dirty dirty;
+struct Shown shown;
+// Frames the incremental mode drew, and how many of them had nothing to
+// redraw, and the fraction of the canvas the last one redrew.
+unsigned long incremental_frames;
+unsigned long zero_redraw_frames;
+double redrawn_fraction;
+#ifdef CANVAS_STATS
+CanvasStats frame_stats;
+#endif
 
 
 double min(double a, double b) {
@@ -49,106 +206,609 @@ double random_y() {
 // negative half the time, and with a bias toward 0.
 // https://www.desmos.com/calculator/7uspuyiuu5
 double random_speed() {
-	return pow(0.5, (5 * rand_01()) + 4) * (rand() % 2 ? 1 : -1) * SPEED_MULTIPLIER;
+	return pow(0.5, (5 * rand_01()) + 4) * (rand() % 2 ? 1 : -1) * config.speed_multiplier;
 }
 
 
-double distance(double x1, double y1, double x2, double y2) {
-	return sqrt(pow(x1 - x2, 2) + pow(y1 - y2, 2));
+// Gives each of the particle_count particles a random position and velocity.
+void spawn_particles() {
+	double speed_scale = 60 / simulation_rate;
+	particles_free(&particles);
+	particles_init(&particles, particle_count);
+	for (int i = 0; i < particle_count; i++) {
+		particles.x[i] = random_x();
+		particles.y[i] = random_y();
+		particles.vx[i] = random_speed() * speed_scale;
+		particles.vy[i] = random_speed() * speed_scale;
+	}
 }
 
 
-void line_between(double x1, double y1, double x2, double y2) {
-	double dist = distance(x1, y1, x2, y2);
-	if (dist < THRESHOLD) {
-		// Change the thickness and opacity of the line connecting
-		// two particles based on their distance from each other.
-		// The closer they are, the thicker and more opaque the line.
-		double opacity = (THRESHOLD / dist) - 1;
-		char color[20 + 8 + 1 + 1];
-		sprintf(color, "rgba(229, 227, 223, %f)", opacity);
-		context->setLineWidth(context, min(opacity, PARTICLE_SIZE));
-		context->setStrokeStyle(context, color);
-		context->beginPath(context);
-		context->moveTo(context, x1, y1);
-		context->lineTo(context, x2, y2);
-		context->stroke(context);
+// Formats the stroke style and picks the line width of every level once, so
+// drawing never has to.
+void build_line_styles() {
+	line_style_count = 0;
+	for (int level = 0; level < LINE_LEVELS; ++level) {
+		double opacity = (level + 0.5) * config.particle_size / LINE_LEVELS;
+		char style[32];
+		sprintf(style, "rgba(229, 227, 223, %f)", min(opacity, 1));
+		if (line_style_count == 0 || strcmp(style, line_styles[line_style_count - 1]) != 0) {
+			strcpy(line_styles[line_style_count++], style);
+		}
+		line_style_of_level[level] = line_styles[line_style_count - 1];
+		line_widths[level] = opacity;
+		line_opacities[level] = min(opacity, 1);
+		line_reaches[level] = (opacity > 1 ? opacity : 1) / 2 + 1;
 	}
 }
 
 
-void draw_particle(double x, double y) {
-	context->beginPath(context);
-	context->arc(context, x, y, PARTICLE_SIZE, 0, 2 * M_PI);
-	context->fill(context);
+// Change the thickness and opacity of the line connecting two particles
+// based on their distance from each other. The closer they are, the thicker
+// and more opaque the line. `dist` must be less than the threshold. Drawing
+// looks the level up with line_level() instead.
+int line_level_of_distance(double dist) {
+	double opacity = (config.threshold / dist) - 1;
+	int level = (int)(min(opacity, config.particle_size) * LINE_LEVELS / config.particle_size);
+	return level < LINE_LEVELS ? level : LINE_LEVELS - 1;
 }
 
 
-void animate() {
-	int canvas_width = Window()->getInnerWidth();
-	int canvas_height = Window()->getInnerHeight();
-	canvas->setWidth(canvas, canvas_width);
-	canvas->setHeight(canvas, canvas_height);
+// The smallest squared distance whose line is below `level`. The level only
+// ever drops as the distance grows, so halving the range until its ends are
+// neighboring doubles finds it exactly.
+double level_boundary(int level) {
+	double low = 0;
+	double high = config.threshold * config.threshold;
+	for (;;) {
+		double middle = low + (high - low) / 2;
+		if (middle <= low || middle >= high) {
+			return high;
+		}
+		if (line_level_of_distance(sqrt(middle)) >= level) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+}
 
-	// I don't know why I have to re-set the fill style every frame, but it
-	// goes to #000000 otherwise.
-	context->setFillStyle(context, "#e5e3df");
 
-	// Draw the particles and the lines between them.
-	for (int i = 0; i < PARTICLE_COUNT; ++i) {
-		draw_particle(particles[i].x, particles[i].y);
+// Splits the squared distances below the threshold into equal bins, fine enough
+// that no bin holds more than one of the boundaries where the level drops,
+// and records each bin's level at its start and where in it the level drops,
+// if it does. Looking a level up then takes a multiply, a load and a compare,
+// and gives exactly the level line_level_of_distance() would have.
+void build_level_bins() {
+	double boundaries[LINE_LEVELS];
+	double narrowest = config.threshold * config.threshold;
+	for (int level = 1; level < LINE_LEVELS; ++level) {
+		boundaries[level] = level_boundary(level);
+	}
+	for (int level = 1; level + 1 < LINE_LEVELS; ++level) {
+		narrowest = min(narrowest, boundaries[level] - boundaries[level + 1]);
+	}
+	level_bin_count = (int)ceil(config.threshold * config.threshold / narrowest);
+	for (;;) {
+		level_bin_scale = level_bin_count / (config.threshold * config.threshold);
+		// One more bin for squared distances that round up into it.
+		level_bins = realloc(level_bins, (level_bin_count + 1) * sizeof(struct LevelBin));
+		for (int bin = 0; bin <= level_bin_count; ++bin) {
+			level_bins[bin] = (struct LevelBin){INFINITY, -1};
+		}
+		// Boundaries go from the farthest, level 1, to the nearest.
+		int crowded = 0;
+		for (int level = 1; level < LINE_LEVELS; ++level) {
+			int bin = (int)(boundaries[level] * level_bin_scale);
+			crowded = crowded || level_bins[bin].drop != INFINITY;
+			level_bins[bin].drop = boundaries[level];
+		}
+		if (!crowded) {
+			break;
+		}
+		level_bin_count *= 2;
+	}
+	int level = LINE_LEVELS - 1;
+	for (int bin = 0; bin <= level_bin_count; ++bin) {
+		level_bins[bin].level = level;
+		level -= level_bins[bin].drop != INFINITY;
+	}
+}
 
-		for (int j = i + 1; j < PARTICLE_COUNT; ++j) {
-			line_between(particles[i].x, particles[i].y, particles[j].x, particles[j].y);
+
+// The level of a line between two particles distance_squared apart, which
+// must be less than the threshold squared.
+int line_level(double distance_squared) {
+	struct LevelBin const *bin = &level_bins[(int)(distance_squared * level_bin_scale)];
+	return bin->level - (distance_squared >= bin->drop);
+}
+
+
+// Works out the level of every line in pairs, once a frame, for whichever
+// renderer draws them.
+void level_lines() {
+	lines_by_level = arenaAlloc(&frame_arena, snapshot->pairs.count * sizeof(int));
+	pair_levels = arenaAlloc(&frame_arena, snapshot->pairs.count * sizeof(int));
+	line_buckets = arenaAlloc(&frame_arena, snapshot->pairs.count * sizeof(int));
+	for (int k = 0; k < snapshot->pairs.count; ++k) {
+		pair_levels[k] = line_level(snapshot->pairs.items[k].distance_squared);
+	}
+}
+
+
+// Draws every line in pairs, or, given only, every line that reaches its
+// marked tiles, one path per level, with a single strokeSegmentBuckets()
+// call. level_lines() must have been called.
+void draw_lines(CanvasRenderingContext2D *ctx, struct Dirty const *only) {
+	// Bucket the lines by level with a counting sort.
+	for (int level = 0; level <= LINE_LEVELS; ++level) {
+		level_start[level] = 0;
+	}
+	for (int k = 0; k < snapshot->pairs.count; ++k) {
+		struct Pair *pair = &snapshot->pairs.items[k];
+		line_buckets[k] = pair_levels[k];
+		if (only && !dirty_touches_segment(only, drawn_x[pair->i], drawn_y[pair->i], drawn_x[pair->j], drawn_y[pair->j],
+				line_reaches[pair_levels[k]])) {
+			line_buckets[k] = -1;
+			continue;
 		}
+		++level_start[line_buckets[k] + 1];
+	}
+	for (int level = 0; level < LINE_LEVELS; ++level) {
+		level_start[level + 1] += level_start[level];
+	}
+	for (int k = 0; k < snapshot->pairs.count; ++k) {
+		if (line_buckets[k] >= 0) {
+			lines_by_level[level_start[line_buckets[k]]++] = k;
+		}
+	}
+	for (int level = LINE_LEVELS; level > 0; --level) {
+		level_start[level] = level_start[level - 1];
+	}
+	level_start[0] = 0;
+
+	float *segments = arenaAlloc(&frame_arena, level_start[LINE_LEVELS] * 4 * sizeof(float));
+	for (int k = 0; k < level_start[LINE_LEVELS]; ++k) {
+		struct Pair *pair = &snapshot->pairs.items[lines_by_level[k]];
+		segments[4 * k] = drawn_x[pair->i];
+		segments[4 * k + 1] = drawn_y[pair->i];
+		segments[4 * k + 2] = drawn_x[pair->j];
+		segments[4 * k + 3] = drawn_y[pair->j];
+	}
+	ctx->strokeSegmentBuckets(ctx, segments, level_start, LINE_LEVELS, line_widths, line_style_of_level);
+}
 
-		particles[i].x = particles[i].x + particles[i].vx;
-		particles[i].y = particles[i].y + particles[i].vy;
 
-		// Bounce off the edges of the screen.
-		// Snap to the edge of the screen, too, so it doesn't disappear in case
-		// the browser is resized.
-		if (particles[i].x < PARTICLE_SIZE) {  // Left edge
-			particles[i].vx *= -1;
-			particles[i].x = PARTICLE_SIZE;
+// Draws every particle, or, given only, every particle that reaches its
+// marked tiles, as one path with a single fillCircles() call.
+void draw_particles(CanvasRenderingContext2D *ctx, struct Dirty const *only) {
+	float *circles = arenaAlloc(&frame_arena, snapshot->count * 3 * sizeof(float));
+	int count = 0;
+	for (int i = 0; i < snapshot->count; ++i) {
+		if (only && !dirty_touches_rect(only, drawn_x[i], drawn_y[i], drawn_x[i], drawn_y[i], config.particle_size + 1)) {
+			continue;
 		}
-		else if (particles[i].x > canvas_width - PARTICLE_SIZE) {  // Right edge
-			particles[i].vx *= -1;
-			particles[i].x = canvas_width - PARTICLE_SIZE;
+		circles[3 * count] = drawn_x[i];
+		circles[3 * count + 1] = drawn_y[i];
+		circles[3 * count + 2] = config.particle_size;
+		++count;
+	}
+	ctx->fillCircles(ctx, circles, count);
+}
+
+
+#ifdef CANVAS_STATS
+// Lists how many times the previous frame called each canvas function, and
+// how many calls into JavaScript those made and how many did nothing, in the
+// top left corner. The counts include the overlay's own calls.
+void draw_stats_overlay() {
+	char lines[CANVAS_CALL_COUNT + 2][64];
+	int line_count = 0;
+	sprintf(lines[line_count++], "%-24s %6lu", "JavaScript crossings", frame_stats.crossings);
+	sprintf(lines[line_count++], "%-24s %6lu", "Elided calls", frame_stats.elided);
+	for (int call = 0; call < CANVAS_CALL_COUNT; ++call) {
+		if (frame_stats.calls[call] == 0) {
+			continue;
+		}
+		if (CANVAS_STATS_TIMING) {
+			sprintf(lines[line_count++], "%-24s %6lu %8.3f ms", canvasCallName(call),
+				frame_stats.calls[call], frame_stats.milliseconds[call]);
+		} else {
+			sprintf(lines[line_count++], "%-24s %6lu", canvasCallName(call), frame_stats.calls[call]);
+		}
+	}
+
+	context->setFillStyle(context, "rgba(0, 0, 0, 0.6)");
+	context->fillRect(context, 0, 0, 320, 8 + 16 * line_count);
+	context->setFillStyle(context, "#e5e3df");
+	context->setFont(context, "12px monospace");
+	for (int line = 0; line < line_count; ++line) {
+		context->fillText(context, lines[line], 8, 20 + 16 * line, -1);
+	}
+}
+#endif
+
+
+// Draws every line in pairs with one instanced call, at the same width and
+// opacity as draw_lines() gives it. Each line's instance is its x0, y0, x1,
+// y1, width and opacity. level_lines() must have been called.
+void draw_lines_instanced() {
+	float *line_instances = arenaAlloc(&frame_arena, snapshot->pairs.count * 6 * sizeof(float));
+	float *line = line_instances;
+	for (int k = 0; k < snapshot->pairs.count; ++k, line += 6) {
+		struct Pair *pair = &snapshot->pairs.items[k];
+		int level = pair_levels[k];
+		line[0] = drawn_x[pair->i];
+		line[1] = drawn_y[pair->i];
+		line[2] = drawn_x[pair->j];
+		line[3] = drawn_y[pair->j];
+		line[4] = line_widths[level];
+		line[5] = line_opacities[level];
+	}
+	renderer->drawLines(renderer, line_instances, snapshot->pairs.count, 229 / 255.0f, 227 / 255.0f, 223 / 255.0f);
+}
+
+
+// Draws every particle with one instanced call.
+void draw_particles_instanced() {
+	float *dot_centers = arenaAlloc(&frame_arena, snapshot->count * 2 * sizeof(float));
+	for (int i = 0; i < snapshot->count; ++i) {
+		dot_centers[2 * i] = drawn_x[i];
+		dot_centers[2 * i + 1] = drawn_y[i];
+	}
+	renderer->drawDots(renderer, dot_centers, snapshot->count, config.particle_size, 229 / 255.0f, 227 / 255.0f, 223 / 255.0f);
+}
+
+
+// Points drawn_x and drawn_y at the particles blend of the way from the step
+// before the snapshot's to the snapshot's.
+void blend_positions(double blend) {
+	if (blend == 1) {
+		drawn_x = snapshot->x;
+		drawn_y = snapshot->y;
+		return;
+	}
+	coord *blended_x = arenaAlloc(&frame_arena, snapshot->count * sizeof(coord));
+	coord *blended_y = arenaAlloc(&frame_arena, snapshot->count * sizeof(coord));
+	for (int i = 0; i < snapshot->count; ++i) {
+		blended_x[i] = snapshot->x[i] + (snapshot->previous_x[i] - snapshot->x[i]) * (1 - blend);
+		blended_y[i] = snapshot->y[i] + (snapshot->previous_y[i] - snapshot->y[i]) * (1 - blend);
+	}
+	drawn_x = blended_x;
+	drawn_y = blended_y;
+}
+
+
+// Redraws the parts of the layer that changed, clipped to them, and copies
+// them to the canvas. Frames where nothing changed draw nothing at all.
+void draw_incremental(int width, int height) {
+	int full = 0;
+	if (layer->getWidth(layer) != width || layer->getHeight(layer) != height) {
+		layer->setWidth(layer, width);
+		layer->setHeight(layer, height);
+		canvas->setWidth(canvas, width);
+		canvas->setHeight(canvas, height);
+		full = 1;
+	}
+	dirty_begin(&dirty, width, height);
+	dirty_mark_changes(&dirty, &shown, full || incremental_frames == 0, snapshot->count, drawn_x, drawn_y,
+		&snapshot->pairs, pair_levels);
+	// Draw the particles where the layer shows them.
+	drawn_x = shown.x;
+	drawn_y = shown.y;
+	++incremental_frames;
+	redrawn_fraction = dirty_fraction(&dirty);
+	if (dirty.marked == 0) {
+		++zero_redraw_frames;
+	} else {
+		dirty_end(&dirty);
+		int everything = dirty.marked == dirty.columns * dirty.rows;
+		layer_context->save(layer_context);
+		if (!everything) {
+			layer_context->beginPath(layer_context);
+			for (int r = 0; r < dirty.rect_count; ++r) {
+				struct DirtyRect *rect = &dirty.rects[r];
+				layer_context->rect(layer_context, rect->x, rect->y, rect->width, rect->height);
+			}
+			layer_context->clip(layer_context);
 		}
-		if (particles[i].y < PARTICLE_SIZE) {  // Top edge
-			particles[i].vy *= -1;
-			particles[i].y = PARTICLE_SIZE;
+		for (int r = 0; r < dirty.rect_count; ++r) {
+			struct DirtyRect *rect = &dirty.rects[r];
+			layer_context->clearRect(layer_context, rect->x, rect->y, rect->width, rect->height);
 		}
-		else if (particles[i].y > canvas_height - PARTICLE_SIZE) {  // Bottom edge
-			particles[i].vy *= -1;
-			particles[i].y = canvas_height - PARTICLE_SIZE;
+		layer_context->setFillStyle(layer_context, "#e5e3df");
+		draw_lines(layer_context, everything ? NULL : &dirty);
+		draw_particles(layer_context, everything ? NULL : &dirty);
+		layer_context->restore(layer_context);
+		layer_context->flush(layer_context);
+	}
+
+#ifdef CANVAS_STATS
+	// The overlay covers part of the canvas every frame, so all of it is
+	// copied back.
+	context->clearRect(context, 0, 0, width, height);
+	context->drawImage(context, layer, 0, 0, width, height, 0, 0, width, height);
+	draw_stats_overlay();
+#else
+	for (int r = 0; r < dirty.rect_count; ++r) {
+		struct DirtyRect *rect = &dirty.rects[r];
+		context->clearRect(context, rect->x, rect->y, rect->width, rect->height);
+		context->drawImage(context, layer, rect->x, rect->y, rect->width, rect->height,
+			rect->x, rect->y, rect->width, rect->height);
+	}
+#endif
+	context->flush(context);
+}
+
+
+// The time the frame being drawn is for.
+double frame_time() {
+#ifdef HEADLESS
+	if (!real_time_frames) {
+		return frames_started++ * 1000 / display_rate;
+	}
+#endif
+	return performanceNow();
+}
+
+
+// Follows the page being shown and hidden and the window gaining and losing
+// focus, and logs how many frames were drawn in each state so far.
+void window_state_changed(int hidden, int focused, void *user_data) {
+	enum PowerState state = power_state(hidden, focused);
+	if (state == power.state) {
+		return;
+	}
+#ifdef HEADLESS
+	power_set_state(&power, state);
+#else
+	int was_paused = power_paused(&power);
+	power_set_state(&power, state);
+	if (power_paused(&power) && !was_paused) {
+		emscripten_pause_main_loop();
+	} else if (!power_paused(&power) && was_paused) {
+		emscripten_resume_main_loop();
+	}
+#endif
+	char message[128];
+	sprintf(message, "Now %s; frames drawn: %lu active, %lu unfocused, %lu hidden", power_state_name(state),
+		power.frames[POWER_ACTIVE], power.frames[POWER_UNFOCUSED], power.frames[POWER_HIDDEN]);
+	consoleLog(message);
+}
+
+
+// How many particles the quality controller's level keeps.
+int quality_particle_count() {
+	return (int)ceil(particle_count * quality_fraction(&quality));
+}
+
+
+// Publishes the quality controller's report, and logs it if the level just
+// changed.
+void report_quality(int changed) {
+	struct QualityReport report;
+	char json[256];
+	quality_report(&quality, &report);
+	quality_report_json(&report, json, sizeof(json));
+	publishTelemetry("quality", json);
+	if (changed) {
+		char message[160];
+		sprintf(message, "Quality level %d of %d: %d of %d particles (average cost %.2f ms, budget %.2f ms)",
+			report.level, report.level_count, quality_particle_count(), particle_count, report.average, report.budget);
+		consoleLog(message);
+	}
+}
+
+
+// Starts the quality controller over at full quality.
+void reset_quality() {
+	quality_init(&quality, config.frame_budget);
+	simulation_set_active(&simulation, particle_count);
+}
+
+
+// Feeds the frame's cost to the quality controller, and has the simulator
+// search and publish fewer or more particles if it changes the level.
+void update_quality(double milliseconds) {
+	int changed = quality_update(&quality, milliseconds);
+	if (changed) {
+		simulation_set_active(&simulation, quality_particle_count());
+	}
+	if (changed || quality.budget > 0 && quality.frames % QUALITY_TELEMETRY_INTERVAL == 0) {
+		report_quality(changed);
+	}
+}
+
+
+void log_frame_time(double milliseconds) {
+	static double total = 0;
+	static int frames = 0;
+	total += milliseconds;
+	if (++frames == FRAME_TIME_LOG_INTERVAL) {
+		char message[128];
+		if (layer) {
+			sprintf(message, "Average frame time: %.3f ms; %lu of %lu frames had nothing to redraw", total / frames,
+				zero_redraw_frames, incremental_frames);
+		} else {
+			sprintf(message, "Average frame time: %.3f ms", total / frames);
 		}
+		consoleLog(message);
+		total = 0;
+		frames = 0;
 	}
 }
 
 
-int main() {
-	srand(time(NULL));
+void animate() {
+	double now = frame_time();
+	if (!power_should_draw(&power, now)) {
+		return;
+	}
+	arenaReset(&frame_arena);
+	if (power.pause_length > 0) {
+		simulation_delay(&simulation, power.pause_length);
+	}
+	double frame_start = performanceNow();
+#ifdef CANVAS_STATS
+	if (context) {
+		canvasStatsSnapshot(context, &frame_stats);
+		canvasStatsReset(context);
+	}
+#endif
+	int canvas_width = Window()->getInnerWidth();
+	int canvas_height = Window()->getInnerHeight();
+
+	// Ask for the steps due by now and take the newest finished one. With the
+	// simulation on its own thread, neither waits: the steps asked for here
+	// are drawn in a later frame. Otherwise they're taken right here.
+	simulation_request(&simulation, canvas_width, canvas_height, now);
+	snapshot = simulation_acquire(&simulation);
+	double draw_start = performanceNow();
+	last_frame.simulation_wait = draw_start - frame_start;
+	last_frame.simulation = snapshot->simulation_time;
+	last_frame.pair_search = snapshot->pair_search_time;
+	if (snapshot->step == 0) {
+		return;
+	}
+	blend_positions(simulation_blend(&simulation, snapshot, now));
+	level_lines();
+
+	if (renderer) {
+		renderer->beginFrame(renderer, canvas_width, canvas_height);
+	} else if (layer) {
+		draw_incremental(canvas_width, canvas_height);
+	} else {
+		// Resizing reallocates the canvas and resets the context, so it's only
+		// done when the window's size has changed; it clears the canvas, too.
+		if (canvas->getWidth(canvas) != canvas_width || canvas->getHeight(canvas) != canvas_height) {
+			canvas->setWidth(canvas, canvas_width);
+			canvas->setHeight(canvas, canvas_height);
+		} else {
+			context->clearRect(context, 0, 0, canvas_width, canvas_height);
+		}
+		// The stats overlay changes the fill style, so it's set every frame;
+		// the context skips the call when it's already set.
+		context->setFillStyle(context, "#e5e3df");
+	}
+
+	// Draw the lines between the particles, then the particles on top.
+	if (renderer) {
+		draw_lines_instanced();
+		draw_particles_instanced();
+	} else if (!layer) {
+		draw_lines(context, NULL);
+		draw_particles(context, NULL);
+#ifdef CANVAS_STATS
+		draw_stats_overlay();
+#endif
+		context->flush(context);
+	}
+
+	double frame_end = performanceNow();
+	last_frame.draw = frame_end - draw_start;
+	last_frame.total = frame_end - frame_start;
+	last_frame.cost = fmax(last_frame.total, last_frame.simulation + last_frame.pair_search);
+	if (FRAME_TIME_LOG_INTERVAL) {
+		log_frame_time(last_frame.total);
+	}
+	update_quality(last_frame.cost);
+}
 
-	emscripten_console_log("Initializing canvas...");
+
+// Creates the canvas and what draws to it, the particles and the simulation,
+// on the thread that is going to draw, which the window's events then go to.
+void start() {
+	consoleLog("Initializing canvas...");
 	canvas = createCanvas("root");
-	context = canvas->getContext(canvas, "2d");
+	if (use_instanced_renderer) {
+		renderer = createInstancedRenderer(canvas);
+	}
+	if (renderer) {
+		consoleLog("Drawing with the instanced renderer.");
+	} else {
+		context = canvas->getContext(canvas, "2d");
+		if (RECORD_DRAW_CALLS) {
+			context->beginRecording(context);
+		}
+#ifdef CANVAS_STATS
+		canvasStatsSetTiming(context, CANVAS_STATS_TIMING);
+#endif
+		if (use_incremental_rendering) {
+			layer = createOffscreenCanvas(Window()->getInnerWidth(), Window()->getInnerHeight());
+			layer_context = layer->getContext(layer, "2d");
+			if (RECORD_DRAW_CALLS) {
+				layer_context->beginRecording(layer_context);
+			}
+			dirty_init(&dirty, DIRTY_TILE_SIZE);
+			shown_init(&shown, incremental_tolerance, config.particle_size + 1, line_reaches);
+			consoleLog("Drawing incrementally, through an offscreen layer.");
+		}
+	}
 	canvas->setWidth(canvas, Window()->getInnerWidth());
 	canvas->setHeight(canvas, Window()->getInnerHeight());
-	emscripten_console_log("Initialized canvas.");
+	consoleLog("Initialized canvas.");
 
 	// Populate particle array with random values.
-	emscripten_console_log("Generating particles...");
-	for (int i = 0; i < PARTICLE_COUNT; i++) {
-		particles[i].x = random_x();
-		particles[i].y = random_y();
-		particles[i].vx = random_speed();
-		particles[i].vy = random_speed();
+	consoleLog("Generating particles...");
+	particle_count = config_particle_count(&config, Window()->getInnerWidth(), Window()->getInnerHeight());
+	particles_init(&particles, 0);
+	spawn_particles();
+	char message[64];
+	sprintf(message, "Generated %d particles.", particle_count);
+	consoleLog(message);
+	simulation_init(&simulation, &particles, config.threshold, config.particle_size);
+	simulation.step_interval = 1000 / simulation_rate;
+	power_init(&power);
+	reset_quality();
+	power.rates[POWER_ACTIVE] = render_rate_cap;
+	power.rates[POWER_UNFOCUSED] = UNFOCUSED_RENDER_RATE;
+	power.rates[POWER_HIDDEN] = HIDDEN_RENDER_RATE;
+	power_set_state(&power, power_state(Window()->isHidden(), Window()->hasFocus()));
+	Window()->setStateListener(window_state_changed, NULL);
+	if (use_simulation_thread && simulation_start(&simulation) != 0) {
+		consoleLog("Couldn't start the simulation thread; stepping on this one.");
+	}
+	pool_init(&pair_search_pool, pair_search_threads ? pair_search_threads : hardwareConcurrency());
+	if (pair_search_pool.thread_count > 1) {
+		sprintf(message, "Searching for pairs on %d threads.", pair_search_pool.thread_count);
+		consoleLog(message);
+		simulation.pool = &pair_search_pool;
 	}
-	emscripten_console_log("Generated particles.");
+	build_line_styles();
+	build_level_bins();
+	arenaInit(&frame_arena, FRAME_ARENA_SIZE);
 
-	emscripten_console_log("Starting simulation.");
-	emscripten_set_main_loop(&animate, 0, 1);
+	consoleLog("Starting simulation.");
+}
+
+
+int main(int argc, char **argv) {
+	config_init(&config);
+#ifdef HEADLESS
+	harness_parse_options(argc, argv);
+#else
+	char *settings = pageSettings("config");
+	config_set_query(&config, settings);
+	free(settings);
+	srand(time(NULL));
+#endif
+
+	if (use_render_thread && render_thread_start(&render_thread, "root", start, animate) == 0) {
+		consoleLog("Drawing on a render thread.");
+	} else {
+		start();
+	}
+#ifdef HEADLESS
+	int status = harness_run();
+	render_thread_stop(&render_thread);
+	simulation_free(&simulation);
+	pool_free(&pair_search_pool);
+	arenaFree(&frame_arena);
+	return status;
+#else
+	if (!render_thread.running) {
+		emscripten_set_main_loop(&animate, 0, 1);
+	}
 	return 0;
+#endif
 }
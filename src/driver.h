@@ -0,0 +1,87 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "canvas.h"  // HTMLCanvasElement
+#include "config.h"  // Config
+#include "pool.h"  // Pool
+#include "power.h"  // Power
+#include "quality.h"  // Quality
+#include "render_thread.h"  // RenderThread
+#include "simulation.h"  // Simulation, Snapshot
+
+// The driver's state: what it sets up in start() and what animate() leaves
+// behind after each frame. The native build's harness (harness.c) sets the
+// options and reads the rest to run its checks and benchmarks.
+
+// The time the last frame spent in each of its phases, in milliseconds.
+// simulation and pair_search are the simulator's times for the step that was
+// drawn, wherever it ran. simulation_wait is how long the frame spent asking
+// for a step and taking one: the whole step when the simulation runs on the
+// drawing thread, and next to nothing when it has a thread of its own. cost
+// is what the quality controller holds to the budget: the frame's total, or
+// the step's simulation and pair search if they took longer, since a
+// simulator on its own thread that takes longer than a frame falls behind
+// and drops steps, however quickly the frames are drawn.
+struct FrameTiming {
+	double simulation;
+	double pair_search;
+	double simulation_wait;
+	double draw;
+	double total;
+	double cost;
+};
+
+// A bin of squared distances: the level of the lines at its start, and where
+// in it the level drops by one, or INFINITY if it doesn't.
+struct LevelBin {
+	double drop;
+	int level;
+};
+
+// Options, set before start().
+extern struct Config config;
+extern int use_instanced_renderer;
+extern int use_incremental_rendering;
+extern int use_simulation_thread;
+extern int use_render_thread;
+extern int pair_search_threads;
+extern double simulation_rate;
+extern double render_rate_cap;
+extern double incremental_tolerance;
+#ifdef HEADLESS
+extern double display_rate;
+extern int real_time_frames;
+#endif
+
+extern int particle_count;
+extern HTMLCanvasElement *canvas;
+extern HTMLCanvasElement *layer;
+extern struct Power power;
+extern struct Quality quality;
+extern struct Simulation simulation;
+extern struct Pool pair_search_pool;
+extern struct RenderThread render_thread;
+extern struct Snapshot const *snapshot;
+extern struct FrameTiming last_frame;
+extern unsigned long incremental_frames;
+extern unsigned long zero_redraw_frames;
+extern double redrawn_fraction;
+extern struct LevelBin *level_bins;
+extern int level_bin_count;
+extern double level_bin_scale;
+
+// Gives each of the particle_count particles a random position and velocity.
+void spawn_particles();
+
+// Starts the quality controller over at full quality.
+void reset_quality();
+
+// The level of a line between two particles dist apart, worked out from the
+// distance, and looked up by the squared distance in the bins.
+int line_level_of_distance(double dist);
+int line_level(double distance_squared);
+
+// Draws a frame, if the display refresh it's called for gets one.
+void animate();
+
+#endif
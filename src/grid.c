@@ -0,0 +1,80 @@
+#include <math.h>  // floor
+#include <stddef.h>  // NULL, size_t
+#include "arena.h"  // Arena, arenaAlloc
+#include "grid.h"
+
+
+void grid_init(struct Grid *grid, double min_cell_size) {
+	grid->min_cell_size = min_cell_size;
+	grid->cell_size = min_cell_size;
+	grid->columns = 0;
+	grid->rows = 0;
+	grid->count = 0;
+	grid->cell_start = NULL;
+	grid->items = NULL;
+	grid->cells = NULL;
+}
+
+
+void grid_begin(struct Grid *grid, struct Arena *arena, int width, int height, int count) {
+	// Wider cells still hold any two points closer than min_cell_size in the
+	// same or adjacent cells; they only hold more points each.
+	double columns, rows;
+	grid->cell_size = grid->min_cell_size;
+	for (;;) {
+		columns = width > 0 ? floor(width / grid->cell_size) + 1 : 1;
+		rows = height > 0 ? floor(height / grid->cell_size) + 1 : 1;
+		if (columns * rows <= GRID_MAX_CELLS) {
+			break;
+		}
+		grid->cell_size *= 2;
+	}
+	grid->columns = (int)columns;
+	grid->rows = (int)rows;
+	grid->count = count;
+
+	size_t cell_count = (size_t)grid->columns * grid->rows;
+	grid->cell_start = arenaAlloc(arena, (cell_count + 1) * sizeof(int));
+	grid->items = arenaAlloc(arena, (size_t)count * sizeof(int));
+	grid->cells = arenaAlloc(arena, (size_t)count * sizeof(int));
+}
+
+
+static int clamp(int value, int low, int high) {
+	return value < low ? low : value > high ? high : value;
+}
+
+
+void grid_place(struct Grid *grid, int index, double x, double y) {
+	// Clamping is monotonic, so two points whose cells were at most one apart
+	// before clamping still are afterward.
+	int column = clamp((int)(x / grid->cell_size), 0, grid->columns - 1);
+	int row = clamp((int)(y / grid->cell_size), 0, grid->rows - 1);
+	grid->cells[index] = row * grid->columns + column;
+}
+
+
+void grid_end(struct Grid *grid) {
+	int cell_count = grid->columns * grid->rows;
+	for (int c = 0; c <= cell_count; ++c) {
+		grid->cell_start[c] = 0;
+	}
+
+	// Count, prefix-sum, then scatter. Scattering in index order keeps every
+	// cell's indices ascending.
+	for (int i = 0; i < grid->count; ++i) {
+		++grid->cell_start[grid->cells[i] + 1];
+	}
+	for (int c = 0; c < cell_count; ++c) {
+		grid->cell_start[c + 1] += grid->cell_start[c];
+	}
+	for (int i = 0; i < grid->count; ++i) {
+		grid->items[grid->cell_start[grid->cells[i]]++] = i;
+	}
+	// Scattering advanced each start to the next cell's start; shift back.
+	for (int c = cell_count; c > 0; --c) {
+		grid->cell_start[c] = grid->cell_start[c - 1];
+	}
+	grid->cell_start[0] = 0;
+}
+
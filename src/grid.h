@@ -0,0 +1,52 @@
+#ifndef GRID_H
+#define GRID_H
+
+// Uniform grid for finding the points near a point. Cells are square and at
+// least min_cell_size wide, so any two points closer than min_cell_size are in
+// the same or adjacent cells.
+//
+// The grid is rebuilt from scratch every frame, in memory from an arena that
+// has to outlive the search:
+//
+//     grid_begin(&grid, &arena, width, height, count);
+//     for (int i = 0; i < count; ++i)
+//         grid_place(&grid, i, x[i], y[i]);
+//     grid_end(&grid);
+//
+// after which every cell's indices can be read from cell_start and items.
+struct Arena;
+
+// The most cells a grid has, however small min_cell_size is next to the area.
+#define GRID_MAX_CELLS (1 << 20)
+
+struct Grid {
+	double min_cell_size;
+	// The width the cells have this time: min_cell_size, or more if that would
+	// take more than GRID_MAX_CELLS cells to cover the area.
+	double cell_size;
+	int columns;
+	int rows;
+	int count;
+	// Cell c holds items[cell_start[c]] up to (not including)
+	// items[cell_start[c + 1]], in ascending order.
+	int *cell_start;
+	int *items;
+	// Cell of each index.
+	int *cells;
+};
+
+void grid_init(struct Grid *grid, double min_cell_size);
+
+// Sizes the grid to cover a width x height area and takes room for `count`
+// indices from the arena.
+void grid_begin(struct Grid *grid, struct Arena *arena, int width, int height, int count);
+
+// Puts an index in the cell that contains (x, y). Points outside the area go
+// in the nearest cell on the edge, which keeps the "same or adjacent cells"
+// guarantee intact.
+void grid_place(struct Grid *grid, int index, double x, double y);
+
+// Buckets every placed index by cell with a counting sort.
+void grid_end(struct Grid *grid);
+
+#endif
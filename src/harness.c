@@ -0,0 +1,505 @@
+#include <math.h>  // sqrt, fmod, nextafter, INFINITY
+#include <stdio.h>  // printf, fprintf, snprintf
+#include <stdlib.h>  // atoi, atof, strtol, strtoul, srand, exit
+#include <string.h>  // strchr, memcpy, memcmp
+#include <time.h>  // nanosleep
+#include <unistd.h>  // getopt
+#include "arena.h"  // heapCallCount
+#include "canvas.h"  // canvasSetRasterizing, canvasWritePPM
+#include "driver.h"  // the driver's state, animate
+#include "harness.h"
+#include "platform.h"  // performanceNow
+#include "samples.h"  // Samples, samples_*
+#include "window.h"  // Window, resizeWindow, setWindowState
+
+// How long the -c check makes every simulation step take, in milliseconds,
+// and how long a frame may wait on the simulator regardless.
+#define CHECK_STEP_DELAY 20
+#define CHECK_WAIT_LIMIT 1.0
+// Benchmarks run this many frames at each particle count before they start
+// measuring, to let the caches and the allocations settle.
+#define BENCHMARK_WARMUP_FRAMES 10
+// The most particle counts one benchmark can sweep over.
+#define BENCHMARK_MAX_RUNS 32
+
+
+// What to run: frame_count frames, written to PPM files if dump_prefix is
+// set, or benchmarked at each of benchmark_counts, or one of the checks.
+static int frame_count = 600;
+static unsigned int seed = 1;
+static char const *dump_prefix = NULL;
+static int benchmark_counts[BENCHMARK_MAX_RUNS];
+static int benchmark_runs = 0;
+static int benchmark_rasterizes = 0;
+static int checking_simulation_wait = 0;
+static int checking_power = 0;
+static int checking_heap = 0;
+static int checking_pairs = 0;
+
+
+static void usage(char const *program) {
+	fprintf(stderr, "usage: %s [-g] [-T] [-R] [-p threads] [-f frames] [-s seed] [-n particles] [-w width] [-h height]\n"
+		"       [-S simulation-rate] [-F display-rate] [-C render-rate-cap] [-I tolerance] [-x setting=value]...\n"
+		"       [-o ppm-prefix | -b count,count,... [-r] | -c | -v | -m | -P]\n", program);
+	exit(2);
+}
+
+
+static void parse_counts(char const *list, char const *program) {
+	char *end;
+	do {
+		long count = strtol(list, &end, 10);
+		if (end == list || count < 1 || benchmark_runs == BENCHMARK_MAX_RUNS) {
+			usage(program);
+		}
+		benchmark_counts[benchmark_runs++] = (int)count;
+		list = end + 1;
+	} while (*end == ',');
+	if (*end != '\0') {
+		usage(program);
+	}
+}
+
+
+static void set_option(char const *name, char const *value, char const *program) {
+	if (config_set(&config, name, value) != 0) {
+		fprintf(stderr, "%s: invalid %s: %s\n", program, name, value);
+		usage(program);
+	}
+}
+
+
+// Sets a setting given as name=value.
+static void set_setting(char const *setting, char const *program) {
+	char name[32];
+	char const *equals = strchr(setting, '=');
+	if (!equals || equals - setting >= (int)sizeof(name)) {
+		usage(program);
+	}
+	memcpy(name, setting, equals - setting);
+	name[equals - setting] = '\0';
+	set_option(name, equals + 1, program);
+}
+
+
+void harness_parse_options(int argc, char **argv) {
+	int option;
+	while ((option = getopt(argc, argv, "f:s:n:w:h:o:b:rgTRcvmPp:S:F:C:I:x:")) != -1) {
+		switch (option) {
+		case 'f': frame_count = atoi(optarg); break;
+		case 's': seed = strtoul(optarg, NULL, 10); break;
+		case 'n': set_option("particles", optarg, argv[0]); break;
+		case 'x': set_setting(optarg, argv[0]); break;
+		case 'w': resizeWindow(atoi(optarg), Window()->getInnerHeight()); break;
+		case 'h': resizeWindow(Window()->getInnerWidth(), atoi(optarg)); break;
+		case 'o': dump_prefix = optarg; break;
+		case 'b': parse_counts(optarg, argv[0]); break;
+		case 'r': benchmark_rasterizes = 1; break;
+		case 'g': use_instanced_renderer = 1; break;
+		case 'T': use_simulation_thread = 1; break;
+		case 'R': use_render_thread = 1; break;
+		// The -c check is about how long real frames wait, so it keeps real time.
+		case 'c': checking_simulation_wait = use_simulation_thread = real_time_frames = 1; break;
+		case 'v': checking_power = 1; break;
+		case 'm': checking_heap = 1; break;
+		case 'P': checking_pairs = 1; break;
+		case 'p': pair_search_threads = atoi(optarg); break;
+		case 'S': simulation_rate = atof(optarg); break;
+		case 'F': display_rate = atof(optarg); break;
+		case 'C': render_rate_cap = atof(optarg); break;
+		case 'I': use_incremental_rendering = 1; incremental_tolerance = atof(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (frame_count < 0 || pair_search_threads < 0 || simulation_rate <= 0 || display_rate <= 0 || render_rate_cap < 0 || incremental_tolerance < 0 || !!dump_prefix + !!benchmark_runs + checking_simulation_wait + checking_power + checking_heap + checking_pairs > 1) {
+		usage(argv[0]);
+	}
+	srand(seed);
+}
+
+
+// Turns the software rasterizer on or off for the canvas and the layer.
+static void set_rasterizing(int on) {
+	canvasSetRasterizing(canvas, on);
+	if (layer) {
+		canvasSetRasterizing(layer, on);
+	}
+}
+
+
+// Draws a frame, on the render thread if there is one. Once it returns, the
+// frame can be read, and the window changed, until the next call.
+static void draw_frame() {
+	if (render_thread.running) {
+		render_thread_draw(&render_thread);
+	} else {
+		animate();
+	}
+}
+
+
+static void run_frames() {
+	for (int frame = 0; frame < frame_count; ++frame) {
+		draw_frame();
+		if (dump_prefix) {
+			char path[1024];
+			snprintf(path, sizeof(path), "%s%05d.ppm", dump_prefix, frame);
+			if (canvasWritePPM(canvas, path) != 0) {
+				fprintf(stderr, "Could not write %s\n", path);
+				exit(1);
+			}
+		}
+	}
+	if (layer) {
+		printf("%lu of %lu frames had nothing to redraw\n", zero_redraw_frames, incremental_frames);
+	}
+	if (quality.budget > 0) {
+		struct QualityReport report;
+		char json[256];
+		quality_report(&quality, &report);
+		quality_report_json(&report, json, sizeof(json));
+		printf("Quality: %s\n", json);
+	}
+}
+
+
+// Makes every simulation step slow and draws frame_count frames as fast as
+// possible, with the rasterizer off so they're quick, to show that drawing
+// doesn't wait for the simulator: many more frames are drawn than steps are
+// taken, and no frame spends more than CHECK_WAIT_LIMIT milliseconds getting
+// its snapshot. Returns 0 if so.
+static int check_simulation_wait() {
+	if (!simulation.threaded) {
+		fprintf(stderr, "There is no simulation thread to check\n");
+		return 1;
+	}
+	simulation.step_delay = CHECK_STEP_DELAY;
+	set_rasterizing(0);
+	double longest_wait = 0;
+	int frames_drawn = 0;
+	unsigned long first_step = 0;
+	while (frames_drawn < frame_count) {
+		draw_frame();
+		longest_wait = last_frame.simulation_wait > longest_wait ? last_frame.simulation_wait : longest_wait;
+		if (snapshot->step != 0) {
+			first_step = first_step ? first_step : snapshot->step;
+			++frames_drawn;
+		}
+	}
+	unsigned long steps = snapshot->step - first_step + 1;
+	simulation_stop(&simulation);
+	printf("Drew %d frames from %lu steps of %d ms; the longest wait for a snapshot was %.3f ms\n",
+		frames_drawn, first_step ? steps : 0, CHECK_STEP_DELAY, longest_wait);
+	return frames_drawn > (long)steps && longest_wait <= CHECK_WAIT_LIMIT ? 0 : 1;
+}
+
+
+// Draws frame_count refreshes' worth of frames with the window focused, then
+// as many unfocused, hidden, and focused again, and checks that each state
+// drew as many frames as its rate allows, and that the particles carry on
+// after the pause from the step they stopped at. Returns 0 if so.
+static int check_power() {
+	int refreshes = frame_count;
+	int states[] = {POWER_ACTIVE, POWER_UNFOCUSED, POWER_HIDDEN, POWER_ACTIVE};
+	unsigned long step_before_pause = 0;
+	unsigned long step_after_pause = 0;
+	set_rasterizing(0);
+	for (int phase = 0; phase < 4; ++phase) {
+		setWindowState(states[phase] == POWER_HIDDEN, states[phase] == POWER_ACTIVE);
+		for (int refresh = 0; refresh < refreshes; ++refresh) {
+			draw_frame();
+			if (phase == 3 && refresh == 0) {
+				step_after_pause = snapshot->step;
+			}
+		}
+		if (phase == 1) {
+			step_before_pause = snapshot->step;
+		}
+	}
+
+	// Expect the number of frames each state's rate fits in its refreshes.
+	int passed = 1;
+	for (int state = 0; state < POWER_STATE_COUNT; ++state) {
+		double rate = power.rates[state];
+		int phases = state == POWER_ACTIVE ? 2 : 1;
+		double expected = rate == POWER_PAUSED ? 0 : rate == 0 || rate >= display_rate ? refreshes : refreshes * rate / display_rate;
+		expected *= phases;
+		printf("%-9s %6lu frames drawn, %6lu refreshes skipped (expected about %.0f frames)\n", power_state_name(state),
+			power.frames[state], power.skipped[state], expected);
+		passed = passed && power.frames[state] >= expected - phases && power.frames[state] <= expected + phases;
+	}
+	printf("Step %lu before the pause, %lu after\n", step_before_pause, step_after_pause);
+	passed = passed && step_after_pause - step_before_pause <= 1;
+	return passed ? 0 : 1;
+}
+
+
+// Draws frame_count frames and checks that the second half of them made no
+// heap calls, on any thread: by then the arenas and buffers have grown to
+// what the frames need.
+static int check_heap() {
+	if (heapCallCount() < 0) {
+		fprintf(stderr, "This build can't count heap calls; build it with make check-heap.\n");
+		return 1;
+	}
+	int warm_up = frame_count / 2;
+	long before = 0;
+	for (int frame = 0; frame < frame_count; ++frame) {
+		if (frame == warm_up) {
+			before = heapCallCount();
+		}
+		draw_frame();
+	}
+	long calls = heapCallCount() - before;
+	printf("%ld heap calls in the last %d of %d frames\n", calls, frame_count - warm_up, frame_count);
+	return calls == 0 ? 0 : 1;
+}
+
+
+// Compares the snapshot's pairs against every i < j the brute-force loop
+// finds closer than the threshold, in the order it visits them, down to the
+// bits of their squared distances. Returns 0 if they're the same; otherwise
+// says where they first differ.
+static int verify_pairs() {
+	coord limit = config.threshold * config.threshold;
+	int k = 0;
+	for (int i = 0; i < snapshot->count; ++i) {
+		for (int j = i + 1; j < snapshot->count; ++j) {
+			coord dx = snapshot->x[j] - snapshot->x[i];
+			coord dy = snapshot->y[j] - snapshot->y[i];
+			coord distance_squared = dx * dx + dy * dy;
+			if (distance_squared >= limit) {
+				continue;
+			}
+			struct Pair const *pair = k < snapshot->pairs.count ? &snapshot->pairs.items[k] : NULL;
+			if (!pair || pair->i != i || pair->j != j || memcmp(&pair->distance_squared, &distance_squared, sizeof(coord)) != 0) {
+				fprintf(stderr, "Step %lu: pair %d should be (%d, %d) at %.17g, but is ", snapshot->step, k, i, j,
+					(double)distance_squared);
+				if (pair) {
+					fprintf(stderr, "(%d, %d) at %.17g\n", pair->i, pair->j, (double)pair->distance_squared);
+				} else {
+					fprintf(stderr, "missing\n");
+				}
+				return 1;
+			}
+			++k;
+		}
+	}
+	if (k != snapshot->pairs.count) {
+		fprintf(stderr, "Step %lu: %d pairs found past the last of %d\n", snapshot->step, snapshot->pairs.count - k, k);
+		return 1;
+	}
+	return 0;
+}
+
+
+// Whether line_level() gives the level line_level_of_distance() does at
+// squared distance d2, and at the two doubles on either side of it, where
+// they're below the threshold squared. Says where they differ if not.
+static int verify_line_level(double d2) {
+	double limit = config.threshold * config.threshold;
+	double below = nextafter(d2, 0);
+	double probes[] = {nextafter(below, 0), below, d2, nextafter(d2, INFINITY), nextafter(nextafter(d2, INFINITY), INFINITY)};
+	for (int p = 0; p < 5; ++p) {
+		if (probes[p] < 0 || probes[p] >= limit) {
+			continue;
+		}
+		int expected = line_level_of_distance(sqrt(probes[p]));
+		if (line_level(probes[p]) != expected) {
+			fprintf(stderr, "Squared distance %.17g: level %d from the bins, %d from the distance\n", probes[p],
+				line_level(probes[p]), expected);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// Checks the level bins against line_level_of_distance() at the start of
+// every bin and every squared distance where the level drops, and around
+// them. Returns 0 if they agree.
+static int check_line_levels() {
+	for (int bin = 0; bin <= level_bin_count; ++bin) {
+		if (verify_line_level(bin / level_bin_scale) != 0) {
+			return 1;
+		}
+		if (level_bins[bin].drop != INFINITY && verify_line_level(level_bins[bin].drop) != 0) {
+			return 1;
+		}
+	}
+	if (verify_line_level(config.threshold * config.threshold) != 0) {
+		return 1;
+	}
+	printf("%d level bins give the levels the distances do\n", level_bin_count + 1);
+	return 0;
+}
+
+
+// Checks the level bins with check_line_levels(), then draws frame_count
+// frames, with the rasterizer off, and checks every one's pairs with
+// verify_pairs(). Returns 0 if they all match.
+static int check_pairs() {
+	if (check_line_levels() != 0) {
+		return 1;
+	}
+	set_rasterizing(0);
+	long pairs = 0;
+	for (int frame = 0; frame < frame_count; ++frame) {
+		draw_frame();
+		if (snapshot->step != 0 && verify_pairs() != 0) {
+			return 1;
+		}
+		pairs += snapshot->pairs.count;
+	}
+	printf("%d frames of %d particles, %ld pairs in all, as the brute-force search finds them\n", frame_count,
+		snapshot->count, pairs);
+	return 0;
+}
+
+
+// Sleeps until refresh number refresh of a display that first refreshed at
+// start, a performanceNow() time, so that a simulator on its own thread gets
+// as much real time between frames as it would in a browser.
+static void wait_for_refresh(double start, long refresh) {
+	double wait = start + refresh * 1000 / display_rate - performanceNow();
+	if (wait > 0) {
+		struct timespec delay = {(time_t)(wait / 1000), (long)(fmod(wait, 1000) * 1000000)};
+		nanosleep(&delay, NULL);
+	}
+}
+
+
+static void print_percentiles(char const *name, struct Samples *samples, char const *separator) {
+	printf("      \"%s\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"mean\": %.4f}%s\n", name,
+		samples_percentile(samples, 50), samples_percentile(samples, 95),
+		samples_percentile(samples, 99), samples_mean(samples), separator);
+}
+
+
+// Runs frame_count frames at every particle count, each from the same seed,
+// and prints the percentiles of each phase's time as JSON on stdout. Draw
+// time is the time it takes to issue the drawing calls: unless -r is given,
+// the software rasterizer, which the browser build does not have, is off.
+// Given -T, the simulator runs on its own thread, as in the browser, and is
+// stopped while each run's particles are spawned. Frames are then drawn at
+// the display rate, in real time, and the simulator's phases' times are
+// those of the step each frame drew.
+static void run_benchmark() {
+	struct Samples simulation_samples, pair_search, draw, total, cost;
+	samples_init(&simulation_samples);
+	samples_init(&pair_search);
+	samples_init(&draw);
+	samples_init(&total);
+	samples_init(&cost);
+	int threaded = simulation.threaded;
+	set_rasterizing(benchmark_rasterizes);
+
+	printf("{\n");
+	printf("  \"seed\": %u,\n", seed);
+	printf("  \"width\": %d,\n", Window()->getInnerWidth());
+	printf("  \"height\": %d,\n", Window()->getInnerHeight());
+	printf("  \"threshold\": %g,\n", config.threshold);
+	printf("  \"particle_size\": %g,\n", config.particle_size);
+	if (quality.budget > 0) {
+		printf("  \"frame_budget\": %g,\n", quality.budget);
+	}
+	printf("  \"frames\": %d,\n", frame_count);
+	printf("  \"warmup_frames\": %d,\n", BENCHMARK_WARMUP_FRAMES);
+	printf("  \"rasterized\": %s,\n", benchmark_rasterizes ? "true" : "false");
+	printf("  \"simulation_thread\": %s,\n", threaded ? "true" : "false");
+	printf("  \"pair_search_threads\": %d,\n", pair_search_pool.thread_count);
+	if (layer) {
+		printf("  \"incremental_tolerance\": %g,\n", incremental_tolerance);
+	}
+	printf("  \"unit\": \"ms\",\n");
+	printf("  \"runs\": [\n");
+	for (int run = 0; run < benchmark_runs; ++run) {
+		particle_count = benchmark_counts[run];
+		srand(seed);
+		simulation_stop(&simulation);
+		spawn_particles();
+		reset_quality();
+		if (threaded) {
+			simulation_start(&simulation);
+		}
+		double refresh_start = performanceNow();
+		long refresh = 0;
+		for (int frame = 0; frame < BENCHMARK_WARMUP_FRAMES; ++frame) {
+			if (threaded) {
+				wait_for_refresh(refresh_start, refresh++);
+			}
+			draw_frame();
+		}
+
+		samples_clear(&simulation_samples);
+		samples_clear(&pair_search);
+		samples_clear(&draw);
+		samples_clear(&total);
+		samples_clear(&cost);
+		double lines = 0;
+		double redrawn = 0;
+		unsigned long zero_redraw_before = zero_redraw_frames;
+		for (int frame = 0; frame < frame_count; ++frame) {
+			if (threaded) {
+				wait_for_refresh(refresh_start, refresh++);
+			}
+			draw_frame();
+			redrawn += redrawn_fraction;
+			samples_add(&simulation_samples, last_frame.simulation);
+			samples_add(&pair_search, last_frame.pair_search);
+			samples_add(&draw, last_frame.draw);
+			samples_add(&total, last_frame.total);
+			samples_add(&cost, last_frame.cost);
+			lines += snapshot->pairs.count;
+		}
+
+		printf("    {\n");
+		printf("      \"particles\": %d,\n", particle_count);
+		printf("      \"mean_lines\": %.1f,\n", frame_count ? lines / frame_count : 0);
+		if (layer) {
+			// The fraction of the canvas redrawn, and the frames with none.
+			printf("      \"mean_redrawn\": %.4f,\n", frame_count ? redrawn / frame_count : 0);
+			printf("      \"zero_redraw_frames\": %lu,\n", zero_redraw_frames - zero_redraw_before);
+		}
+		print_percentiles("simulation", &simulation_samples, ",");
+		print_percentiles("pair_search", &pair_search, ",");
+		print_percentiles("draw", &draw, ",");
+		if (quality.budget > 0) {
+			struct QualityReport report;
+			char json[256];
+			quality_report(&quality, &report);
+			quality_report_json(&report, json, sizeof(json));
+			printf("      \"quality\": %s,\n", json);
+			print_percentiles("cost", &cost, ",");
+		}
+		print_percentiles("frame", &total, "");
+		printf("    }%s\n", run + 1 < benchmark_runs ? "," : "");
+		fflush(stdout);
+	}
+	printf("  ]\n");
+	printf("}\n");
+
+	samples_free(&simulation_samples);
+	samples_free(&pair_search);
+	samples_free(&draw);
+	samples_free(&total);
+	samples_free(&cost);
+}
+
+
+int harness_run() {
+	if (benchmark_runs) {
+		run_benchmark();
+		return 0;
+	} else if (checking_simulation_wait) {
+		return check_simulation_wait();
+	} else if (checking_power) {
+		return check_power();
+	} else if (checking_heap) {
+		return check_heap();
+	} else if (checking_pairs) {
+		return check_pairs();
+	}
+	run_frames();
+	return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+// The native build's command line: it runs a fixed number of frames as fast
+// as it can, from a fixed seed, and can write each one to a PPM file for
+// golden-image tests; or it benchmarks the frames at a list of particle
+// counts; or it runs one of the checks the Makefile's check-* targets run.
+// See usage() in harness.c for the options.
+
+// Sets the driver's options, and the harness's own, from the arguments, and
+// seeds rand(). Exits with a usage message if they aren't valid.
+void harness_parse_options(int argc, char **argv);
+
+// Runs what the options asked for, once the driver has started. Returns the
+// program's exit status.
+int harness_run();
+
+#endif
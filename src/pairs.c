@@ -0,0 +1,223 @@
+#include <math.h>  // sqrt
+#include <stdatomic.h>  // atomic_int
+#include <stdlib.h>  // malloc, realloc, free
+#include <string.h>  // memcpy
+#include "pairs.h"
+#include "simd.h"  // LANES, vector, LOAD, STORE, ...
+
+// The particles are split into this many chunks per thread, which threads
+// take one at a time as they finish the last, so a thread that was given
+// a crowded chunk doesn't hold the others up.
+#define CHUNKS_PER_THREAD 4
+
+// The pairs of particles first up to (not including) last, in the order
+// pairs_find() gives them.
+struct PairChunk {
+	struct Pair *items;
+	int count;
+	int capacity;
+	int first;
+	int last;
+};
+
+// What every thread of a parallel search needs to know.
+struct Search {
+	struct Pairs *pairs;
+	struct Particles const *particles;
+	struct Grid const *grid;
+	coord limit;
+	int chunk_count;
+	atomic_int next_chunk;
+};
+
+
+void pairs_init(struct Pairs *pairs) {
+	pairs->items = NULL;
+	pairs->count = 0;
+	pairs->capacity = 0;
+	pairs->x = NULL;
+	pairs->y = NULL;
+	pairs->coord_capacity = 0;
+	pairs->pool = NULL;
+	pairs->chunks = NULL;
+	pairs->chunk_count = 0;
+}
+
+
+void pairs_free(struct Pairs *pairs) {
+	free(pairs->items);
+	free(pairs->x);
+	free(pairs->y);
+	for (int c = 0; c < pairs->chunk_count; ++c) {
+		free(pairs->chunks[c].items);
+	}
+	free(pairs->chunks);
+	pairs_init(pairs);
+}
+
+
+static void add_pair(struct PairChunk *chunk, int i, int j, coord distance_squared) {
+	if (chunk->count == chunk->capacity) {
+		chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+		chunk->items = realloc(chunk->items, chunk->capacity * sizeof(struct Pair));
+	}
+	struct Pair *pair = &chunk->items[chunk->count++];
+	pair->i = i;
+	pair->j = j;
+	pair->distance_squared = distance_squared;
+}
+
+
+// Adds every particle after i in grid->items[start..end) that is closer to
+// (x, y) than sqrt(limit).
+static void find_in_run(struct PairChunk *chunk, struct Pairs const *pairs, struct Grid const *grid, int start, int end, int i, coord x, coord y, coord limit) {
+	int k = start;
+#if LANES > 1
+	vector xs = SPLAT(x);
+	vector ys = SPLAT(y);
+	vector limits = SPLAT(limit);
+	for (; k + LANES <= end; k += LANES) {
+		vector dx = SUB(LOAD(pairs->x + k), xs);
+		vector dy = SUB(LOAD(pairs->y + k), ys);
+		vector d2 = ADD(MUL(dx, dx), MUL(dy, dy));
+		int hits = MASK(LT(d2, limits));
+		if (hits) {
+			coord lanes[LANES];
+			STORE(lanes, d2);
+			for (int lane = 0; lane < LANES; ++lane) {
+				if (hits >> lane & 1 && grid->items[k + lane] > i) {
+					add_pair(chunk, i, grid->items[k + lane], lanes[lane]);
+				}
+			}
+		}
+	}
+#endif
+	for (; k < end; ++k) {
+		coord dx = pairs->x[k] - x;
+		coord dy = pairs->y[k] - y;
+		coord d2 = dx * dx + dy * dy;
+		if (d2 < limit && grid->items[k] > i) {
+			add_pair(chunk, i, grid->items[k], d2);
+		}
+	}
+}
+
+
+// Finds the pairs of the chunk's particles and the particles after them.
+static void search_chunk(struct PairChunk *chunk, struct Pairs const *pairs, struct Particles const *particles, struct Grid const *grid, coord limit) {
+	chunk->count = 0;
+	for (int i = chunk->first; i < chunk->last; ++i) {
+		int first = chunk->count;
+		int column = grid->cells[i] % grid->columns;
+		int row = grid->cells[i] / grid->columns;
+
+		for (int r = row - 1; r <= row + 1; ++r) {
+			if (r < 0 || r >= grid->rows) {
+				continue;
+			}
+			// The three cells of a row are adjacent in the grid's order, so
+			// they make up one contiguous run.
+			int left = column > 0 ? column - 1 : 0;
+			int right = column < grid->columns - 1 ? column + 1 : column;
+			int start = grid->cell_start[r * grid->columns + left];
+			int end = grid->cell_start[r * grid->columns + right + 1];
+			find_in_run(chunk, pairs, grid, start, end, i, particles->x[i], particles->y[i], limit);
+		}
+
+		// Each row's hits are ascending within a cell but not across them;
+		// there are few enough that insertion sort is the quickest fix.
+		for (int k = first + 1; k < chunk->count; ++k) {
+			struct Pair pair = chunk->items[k];
+			int m = k;
+			for (; m > first && chunk->items[m - 1].j > pair.j; --m) {
+				chunk->items[m] = chunk->items[m - 1];
+			}
+			chunk->items[m] = pair;
+		}
+	}
+}
+
+
+static void search_chunks(void *argument, int thread, int thread_count) {
+	struct Search *search = argument;
+	int c;
+	while ((c = atomic_fetch_add_explicit(&search->next_chunk, 1, memory_order_relaxed)) < search->chunk_count) {
+		search_chunk(&search->pairs->chunks[c], search->pairs, search->particles, search->grid, search->limit);
+	}
+}
+
+
+// Splits the particles into chunk_count ranges with about the same number
+// of candidate pairs each. Particle i is only paired with the particles
+// after it, so its share of the work falls off as count - i, and the ranges
+// get longer toward the end.
+static void split_chunks(struct Pairs *pairs, int count, int chunk_count) {
+	if (chunk_count > pairs->chunk_count) {
+		pairs->chunks = realloc(pairs->chunks, chunk_count * sizeof(struct PairChunk));
+		for (int c = pairs->chunk_count; c < chunk_count; ++c) {
+			pairs->chunks[c].items = NULL;
+			pairs->chunks[c].count = 0;
+			pairs->chunks[c].capacity = 0;
+		}
+		pairs->chunk_count = chunk_count;
+	}
+	int first = 0;
+	for (int c = 0; c < chunk_count; ++c) {
+		int last = c + 1 == chunk_count ? count : (int)(count * (1 - sqrt(1 - (c + 1.0) / chunk_count)));
+		pairs->chunks[c].first = first;
+		pairs->chunks[c].last = last > first ? last : first;
+		first = pairs->chunks[c].last;
+	}
+}
+
+
+void pairs_find(struct Pairs *pairs, struct Particles const *particles, struct Grid const *grid, double threshold) {
+	if (grid->count > pairs->coord_capacity) {
+		pairs->coord_capacity = grid->count;
+		pairs->x = realloc(pairs->x, grid->count * sizeof(coord));
+		pairs->y = realloc(pairs->y, grid->count * sizeof(coord));
+	}
+	for (int k = 0; k < grid->count; ++k) {
+		pairs->x[k] = particles->x[grid->items[k]];
+		pairs->y[k] = particles->y[grid->items[k]];
+	}
+	coord limit = threshold * threshold;
+
+	if (!pairs->pool || pairs->pool->thread_count == 1) {
+		// One chunk that searches straight into the result.
+		struct PairChunk all = {pairs->items, 0, pairs->capacity, 0, grid->count};
+		search_chunk(&all, pairs, particles, grid, limit);
+		pairs->items = all.items;
+		pairs->count = all.count;
+		pairs->capacity = all.capacity;
+		return;
+	}
+
+	int chunk_count = pairs->pool->thread_count * CHUNKS_PER_THREAD;
+	split_chunks(pairs, grid->count, chunk_count);
+	struct Search search = {
+		.pairs = pairs,
+		.particles = particles,
+		.grid = grid,
+		.limit = limit,
+		.chunk_count = chunk_count,
+		.next_chunk = 0,
+	};
+	pool_run(pairs->pool, search_chunks, &search);
+
+	// Concatenating the chunks in order gives the same list one thread would
+	// have found, however many threads there were.
+	int total = 0;
+	for (int c = 0; c < chunk_count; ++c) {
+		total += pairs->chunks[c].count;
+	}
+	if (total > pairs->capacity) {
+		pairs->capacity = total;
+		pairs->items = realloc(pairs->items, total * sizeof(struct Pair));
+	}
+	pairs->count = 0;
+	for (int c = 0; c < chunk_count; ++c) {
+		memcpy(pairs->items + pairs->count, pairs->chunks[c].items, pairs->chunks[c].count * sizeof(struct Pair));
+		pairs->count += pairs->chunks[c].count;
+	}
+}
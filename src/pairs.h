@@ -0,0 +1,47 @@
+#ifndef PAIRS_H
+#define PAIRS_H
+
+#include "grid.h"  // Grid
+#include "particles.h"  // Particles, coord
+#include "pool.h"  // Pool
+
+// Two particles closer together than the line threshold.
+struct Pair {
+	int i;
+	int j;
+	coord distance_squared;
+};
+
+// The pairs found in one frame, reused from frame to frame.
+struct Pairs {
+	struct Pair *items;
+	int count;
+	int capacity;
+	// Particle coordinates in the grid's cell order, so every cell's
+	// particles can be loaded into SIMD lanes straight from memory.
+	coord *x;
+	coord *y;
+	int coord_capacity;
+	// Set to split the search across the pool's threads. Each thread searches
+	// whole chunks of particles into the chunk's own list, and the lists are
+	// concatenated in order afterward.
+	struct Pool *pool;
+	struct PairChunk *chunks;
+	int chunk_count;
+};
+
+void pairs_init(struct Pairs *pairs);
+
+void pairs_free(struct Pairs *pairs);
+
+// Replaces the contents of `pairs` with every pair i < j of particles closer
+// than `threshold`, sorted by i and then j, which is the order the brute-
+// force i < j loop visits them in. `grid` must have been built from the
+// particles' current positions with a cell size of at least `threshold`.
+//
+// Squared distances are compared against threshold² several lanes at a
+// time; no square roots are taken. The result is the same with or without a
+// pool, and whatever its size.
+void pairs_find(struct Pairs *pairs, struct Particles const *particles, struct Grid const *grid, double threshold);
+
+#endif
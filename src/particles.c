@@ -0,0 +1,58 @@
+#include <stdlib.h>  // malloc, free
+#include "particles.h"
+#include "simd.h"  // LANES, vector, LOAD, STORE, ...
+
+
+void particles_init(struct Particles *particles, int count) {
+	particles->count = count;
+	particles->x = malloc(count * sizeof(coord));
+	particles->y = malloc(count * sizeof(coord));
+	particles->vx = malloc(count * sizeof(coord));
+	particles->vy = malloc(count * sizeof(coord));
+}
+
+
+void particles_free(struct Particles *particles) {
+	free(particles->x);
+	free(particles->y);
+	free(particles->vx);
+	free(particles->vy);
+	particles->count = 0;
+}
+
+
+// One axis of particles_integrate(). The lower edge wins if the area is so
+// small that a particle is past both.
+static void integrate_axis(coord *position, coord *velocity, int count, coord low, coord high) {
+	int i = 0;
+#if LANES > 1
+	vector lows = SPLAT(low);
+	vector highs = SPLAT(high);
+	for (; i + LANES <= count; i += LANES) {
+		vector p = LOAD(position + i);
+		vector v = LOAD(velocity + i);
+		p = ADD(p, v);
+		vector below = LT(p, lows);
+		vector above = ANDNOT(GT(p, highs), below);
+		STORE(velocity + i, SELECT(OR(below, above), NEG(v), v));
+		STORE(position + i, SELECT(below, lows, SELECT(above, highs, p)));
+	}
+#endif
+	for (; i < count; ++i) {
+		position[i] = position[i] + velocity[i];
+		if (position[i] < low) {
+			velocity[i] = -velocity[i];
+			position[i] = low;
+		}
+		else if (position[i] > high) {
+			velocity[i] = -velocity[i];
+			position[i] = high;
+		}
+	}
+}
+
+
+void particles_integrate(struct Particles *particles, double width, double height, double margin) {
+	integrate_axis(particles->x, particles->vx, particles->count, margin, width - margin);
+	integrate_axis(particles->y, particles->vy, particles->count, margin, height - margin);
+}
@@ -0,0 +1,38 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+// Particle state, stored as one contiguous array per field so that the
+// integration pass can move several particles per instruction.
+//
+// Coordinates are doubles unless PARTICLES_FLOAT is defined, which halves
+// the memory traffic and doubles the SIMD lane count at the cost of
+// precision that doesn't matter at screen scale.
+#ifdef PARTICLES_FLOAT
+typedef float coord;
+#else
+typedef double coord;
+#endif
+
+struct Particles {
+	int count;
+	coord *x;
+	coord *y;
+	coord *vx;
+	coord *vy;
+};
+
+// Allocates room for `count` particles. Their state is left uninitialized.
+void particles_init(struct Particles *particles, int count);
+
+void particles_free(struct Particles *particles);
+
+// Moves every particle by its velocity, then bounces the ones that left the
+// width x height area (shrunk by `margin` on every side) off its edges:
+// their velocity on that axis is reversed and they are snapped back onto the
+// edge, so they don't disappear if the area shrinks.
+//
+// Uses wasm SIMD128 when built with -msimd128, AVX or SSE2 natively when
+// available, and plain C otherwise. All paths produce identical results.
+void particles_integrate(struct Particles *particles, double width, double height, double margin);
+
+#endif
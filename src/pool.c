@@ -0,0 +1,95 @@
+#include <stdlib.h>  // malloc, free
+#include "pool.h"
+
+
+struct Worker {
+	struct Pool *pool;
+	int thread;
+};
+
+
+static void *serve(void *argument) {
+	struct Worker *worker = argument;
+	struct Pool *pool = worker->pool;
+	unsigned long last_run = 0;
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->run == last_run && !pool->stopping) {
+			pthread_cond_wait(&pool->started, &pool->lock);
+		}
+		if (pool->stopping) {
+			break;
+		}
+		last_run = pool->run;
+		pthread_mutex_unlock(&pool->lock);
+		pool->work(pool->argument, worker->thread, pool->thread_count);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0) {
+			pthread_cond_signal(&pool->finished);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	free(worker);
+	return NULL;
+}
+
+
+void pool_init(struct Pool *pool, int thread_count) {
+	pool->thread_count = 1;
+	pool->threads = malloc((thread_count > 1 ? thread_count - 1 : 1) * sizeof(pthread_t));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->started, NULL);
+	pthread_cond_init(&pool->finished, NULL);
+	pool->work = NULL;
+	pool->argument = NULL;
+	pool->run = 0;
+	pool->busy = 0;
+	pool->stopping = 0;
+	for (int thread = 1; thread < thread_count; ++thread) {
+		struct Worker *worker = malloc(sizeof(struct Worker));
+		worker->pool = pool;
+		worker->thread = thread;
+		if (pthread_create(&pool->threads[thread - 1], NULL, serve, worker) != 0) {
+			free(worker);
+			break;
+		}
+		pool->thread_count = thread + 1;
+	}
+}
+
+
+void pool_free(struct Pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->lock);
+	for (int thread = 1; thread < pool->thread_count; ++thread) {
+		pthread_join(pool->threads[thread - 1], NULL);
+	}
+	free(pool->threads);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->started);
+	pthread_cond_destroy(&pool->finished);
+	pool->thread_count = 0;
+}
+
+
+void pool_run(struct Pool *pool, void (*work)(void *argument, int thread, int thread_count), void *argument) {
+	if (pool->thread_count > 1) {
+		pthread_mutex_lock(&pool->lock);
+		pool->work = work;
+		pool->argument = argument;
+		pool->busy = pool->thread_count - 1;
+		++pool->run;
+		pthread_cond_broadcast(&pool->started);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	work(argument, 0, pool->thread_count);
+	if (pool->thread_count > 1) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->busy > 0) {
+			pthread_cond_wait(&pool->finished, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
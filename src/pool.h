@@ -0,0 +1,40 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>  // pthread_t, pthread_mutex_t, pthread_cond_t
+
+// Runs one function on several threads at once and waits for all of them,
+// for splitting a loop across cores:
+//
+//     pool_init(&pool, 4);
+//     pool_run(&pool, work, argument);  // work(argument, 0..3, 4)
+//
+// The calling thread does share 0 itself, so a pool of one thread starts no
+// threads at all. The threads wait between runs instead of being created
+// for each one.
+struct Pool {
+	int thread_count;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t started;
+	pthread_cond_t finished;
+	void (*work)(void *argument, int thread, int thread_count);
+	void *argument;
+	// Bumped to start each run; the threads remember the last one they ran.
+	unsigned long run;
+	int busy;
+	int stopping;
+};
+
+// Starts thread_count - 1 threads. If a thread can't be started, the pool
+// makes do with the ones that did.
+void pool_init(struct Pool *pool, int thread_count);
+
+void pool_free(struct Pool *pool);
+
+// Calls work(argument, thread, thread_count) on every thread of the pool,
+// with thread from 0 to thread_count - 1, and returns once they've all
+// returned.
+void pool_run(struct Pool *pool, void (*work)(void *argument, int thread, int thread_count), void *argument);
+
+#endif
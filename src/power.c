@@ -0,0 +1,73 @@
+#include "power.h"
+
+
+void power_init(struct Power *power) {
+	power->state = POWER_ACTIVE;
+	for (int state = 0; state < POWER_STATE_COUNT; ++state) {
+		power->rates[state] = 0;
+		power->frames[state] = 0;
+		power->skipped[state] = 0;
+	}
+	power->last_frame = 0;
+	power->next_frame = 0;
+	power->resumed = 0;
+	power->pause_length = 0;
+}
+
+
+enum PowerState power_state(int hidden, int focused) {
+	return hidden ? POWER_HIDDEN : focused ? POWER_ACTIVE : POWER_UNFOCUSED;
+}
+
+
+char const *power_state_name(enum PowerState state) {
+	static char const *names[POWER_STATE_COUNT] = {"active", "unfocused", "hidden"};
+	return names[state];
+}
+
+
+void power_set_state(struct Power *power, enum PowerState state) {
+	if (power_paused(power) && power->rates[state] != POWER_PAUSED) {
+		power->resumed = 1;
+	}
+	power->state = state;
+	// The new state's rate starts from the next refresh.
+	power->next_frame = 0;
+}
+
+
+int power_paused(struct Power const *power) {
+	return power->rates[power->state] == POWER_PAUSED;
+}
+
+
+static unsigned long frames_drawn(struct Power const *power) {
+	unsigned long frames = 0;
+	for (int state = 0; state < POWER_STATE_COUNT; ++state) {
+		frames += power->frames[state];
+	}
+	return frames;
+}
+
+
+int power_should_draw(struct Power *power, double now) {
+	double rate = power->rates[power->state];
+	if (rate == POWER_PAUSED || rate > 0 && now < power->next_frame - 1) {
+		++power->skipped[power->state];
+		return 0;
+	}
+	if (rate > 0) {
+		// Keep to the rate's schedule unless this refresh is a whole frame
+		// late, which starts a new one.
+		double interval = 1000 / rate;
+		power->next_frame = now - power->next_frame < interval ? power->next_frame + interval : now + interval;
+	}
+	power->pause_length = 0;
+	if (power->resumed) {
+		power->resumed = 0;
+		power->pause_length = frames_drawn(power) ? now - power->last_frame : 0;
+	}
+	power->last_frame = now;
+	++power->frames[power->state];
+	return 1;
+}
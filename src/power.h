@@ -0,0 +1,60 @@
+#ifndef POWER_H
+#define POWER_H
+
+// A rate that draws no frames at all.
+#define POWER_PAUSED -1
+
+// What the page is doing, as far as how often it should draw goes.
+enum PowerState {
+	POWER_ACTIVE,  // visible, with focus
+	POWER_UNFOCUSED,  // visible, without focus
+	POWER_HIDDEN,  // in a background tab, minimized, or covered up
+	POWER_STATE_COUNT
+};
+
+// Picks the display refreshes to draw frames on, from the most frames a
+// second the current state allows, and counts the frames drawn in each state:
+//
+//     power_init(&power);
+//     power.rates[POWER_UNFOCUSED] = 30;
+//     // whenever the page is shown or hidden, or gains or loses focus:
+//     power_set_state(&power, power_state(hidden, focused));
+//     // on every display refresh:
+//     if (power_should_draw(&power, now)) {
+//         // skip power.pause_length milliseconds of animation, then draw
+//     }
+struct Power {
+	enum PowerState state;
+	// The most frames a second to draw in each state. 0 draws on every
+	// refresh, and POWER_PAUSED on none.
+	double rates[POWER_STATE_COUNT];
+	// Frames drawn, and refreshes skipped, in each state.
+	unsigned long frames[POWER_STATE_COUNT];
+	unsigned long skipped[POWER_STATE_COUNT];
+	// When the last frame was drawn, and when the next may be.
+	double last_frame;
+	double next_frame;
+	// Set by leaving a paused state. The first frame drawn after it clears
+	// it and sets pause_length to the time since the frame before, so the
+	// animation can pick up where it stopped instead of jumping ahead.
+	int resumed;
+	double pause_length;
+};
+
+void power_init(struct Power *power);
+
+enum PowerState power_state(int hidden, int focused);
+
+char const *power_state_name(enum PowerState state);
+
+void power_set_state(struct Power *power, enum PowerState state);
+
+// Whether the current state draws no frames.
+int power_paused(struct Power const *power);
+
+// Returns whether to draw a frame on the display refresh at now, a
+// performanceNow() timestamp, and counts it either way. Refreshes come a
+// little early or late, so one within a millisecond of its turn is drawn.
+int power_should_draw(struct Power *power, double now);
+
+#endif
@@ -0,0 +1,84 @@
+#include <math.h>  // pow
+#include <stdio.h>  // snprintf
+#include "quality.h"
+
+// How much of each frame time goes into the average.
+#define QUALITY_SMOOTHING 0.1
+// Frames after a change before the level may change again, so the average
+// reflects the new level; and frames the average has to stay low before the
+// level goes up, which takes longer than going down.
+#define QUALITY_SETTLE_FRAMES 30
+#define QUALITY_UPGRADE_FRAMES 120
+// The level goes up only when the average is under this fraction of the
+// budget. The level above costs about 1 / QUALITY_STEP squared as much, so
+// this is under QUALITY_STEP squared to leave it room.
+#define QUALITY_UPGRADE_HEADROOM 0.55
+
+
+void quality_init(struct Quality *quality, double budget) {
+	quality->budget = budget;
+	quality->level = 0;
+	quality->average = 0;
+	quality->settled = 0;
+	quality->frames = 0;
+	quality->frames_within_budget = 0;
+	quality->downgrades = 0;
+	quality->upgrades = 0;
+}
+
+
+int quality_update(struct Quality *quality, double milliseconds) {
+	if (quality->budget <= 0) {
+		return 0;
+	}
+	quality->average = quality->frames ? quality->average + (milliseconds - quality->average) * QUALITY_SMOOTHING : milliseconds;
+	++quality->frames;
+	quality->frames_within_budget += milliseconds <= quality->budget;
+	++quality->settled;
+
+	if (quality->settled >= QUALITY_SETTLE_FRAMES && quality->average > quality->budget
+			&& quality->level + 1 < QUALITY_LEVELS) {
+		++quality->level;
+		++quality->downgrades;
+		quality->settled = 0;
+		return 1;
+	}
+	if (quality->settled >= QUALITY_UPGRADE_FRAMES && quality->average < quality->budget * QUALITY_UPGRADE_HEADROOM
+			&& quality->level > 0) {
+		--quality->level;
+		++quality->upgrades;
+		quality->settled = 0;
+		return 1;
+	}
+	// Upgrading needs the average to stay low the whole time.
+	if (quality->average >= quality->budget * QUALITY_UPGRADE_HEADROOM && quality->settled > QUALITY_SETTLE_FRAMES) {
+		quality->settled = QUALITY_SETTLE_FRAMES;
+	}
+	return 0;
+}
+
+
+double quality_fraction(struct Quality const *quality) {
+	return pow(QUALITY_STEP, quality->level);
+}
+
+
+void quality_report(struct Quality const *quality, struct QualityReport *report) {
+	report->level = quality->level;
+	report->level_count = QUALITY_LEVELS;
+	report->fraction = quality_fraction(quality);
+	report->budget = quality->budget;
+	report->average = quality->average;
+	report->adherence = quality->frames ? (double)quality->frames_within_budget / quality->frames : 1;
+	report->frames = quality->frames;
+	report->downgrades = quality->downgrades;
+	report->upgrades = quality->upgrades;
+}
+
+
+void quality_report_json(struct QualityReport const *report, char *out, int size) {
+	snprintf(out, size, "{\"level\": %d, \"level_count\": %d, \"fraction\": %.4f, \"budget\": %.3f, "
+		"\"average\": %.3f, \"adherence\": %.4f, \"frames\": %lu, \"downgrades\": %lu, \"upgrades\": %lu}",
+		report->level, report->level_count, report->fraction, report->budget, report->average,
+		report->adherence, report->frames, report->downgrades, report->upgrades);
+}
@@ -0,0 +1,66 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+// How many quality levels there are. Level 0 is full quality; each level
+// past it keeps QUALITY_STEP of the particles the level before kept, which,
+// with lines between nearby particles, keeps about QUALITY_STEP squared of
+// the lines.
+#define QUALITY_LEVELS 8
+#define QUALITY_STEP 0.8
+
+// Holds the frame time under a budget by trading quality for it:
+//
+//     quality_init(&quality, 4);
+//     // after every frame drawn:
+//     if (quality_update(&quality, milliseconds)) {
+//         // draw quality_fraction(&quality) of the particles from now on
+//     }
+//
+// The frame time is smoothed, and the level only changes when the average
+// has been over budget for a while, or comfortably under it for longer.
+// Going up a level has to leave enough room that the level above fits,
+// and every change is followed by frames that leave it alone while the
+// average settles, so the level doesn't flip back and forth.
+struct Quality {
+	// Milliseconds a frame may take. 0 turns the controller off.
+	double budget;
+	int level;
+	// The smoothed frame time, and the frames since the level last changed.
+	double average;
+	int settled;
+	// For telemetry: frames measured, those within budget, and the times
+	// the level went down and up.
+	unsigned long frames;
+	unsigned long frames_within_budget;
+	unsigned long downgrades;
+	unsigned long upgrades;
+};
+
+// A summary of the controller's state for telemetry.
+struct QualityReport {
+	int level;
+	int level_count;
+	double fraction;
+	double budget;
+	double average;
+	// The fraction of frames measured that were within budget.
+	double adherence;
+	unsigned long frames;
+	unsigned long downgrades;
+	unsigned long upgrades;
+};
+
+void quality_init(struct Quality *quality, double budget);
+
+// Counts a frame that took milliseconds and returns 1 if the level changed.
+int quality_update(struct Quality *quality, double milliseconds);
+
+// The share of full quality the current level keeps, from 0 to 1.
+double quality_fraction(struct Quality const *quality);
+
+void quality_report(struct Quality const *quality, struct QualityReport *report);
+
+// Writes the report as a JSON object into out, which holds size bytes.
+void quality_report_json(struct QualityReport const *report, char *out, int size);
+
+#endif
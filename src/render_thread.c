@@ -0,0 +1,128 @@
+#ifdef HEADLESS
+#include "window.h"  // dispatchWindowEvents
+#elif defined(__EMSCRIPTEN_PTHREADS__)
+#include <stdio.h>  // snprintf
+#include <emscripten/html5.h>  // emscripten_set_main_loop
+#include <emscripten/threading.h>  // emscripten_pthread_attr_settransferredcanvases
+#include "canvas.h"  // canTransferCanvas
+#endif
+#include "render_thread.h"
+
+
+#ifdef HEADLESS
+// Sets up, then draws the frames it's asked for, taking the window's events
+// before each, as a browser delivers them between frames.
+static void *render(void *argument) {
+	struct RenderThread *render_thread = argument;
+	render_thread->setup();
+	pthread_mutex_lock(&render_thread->lock);
+	render_thread->started = 1;
+	pthread_cond_broadcast(&render_thread->changed);
+	for (;;) {
+		while (render_thread->frames == 0 && !render_thread->quitting) {
+			pthread_cond_wait(&render_thread->changed, &render_thread->lock);
+		}
+		if (render_thread->frames == 0) {
+			break;
+		}
+		pthread_mutex_unlock(&render_thread->lock);
+		dispatchWindowEvents();
+		render_thread->draw();
+		pthread_mutex_lock(&render_thread->lock);
+		--render_thread->frames;
+		pthread_cond_broadcast(&render_thread->changed);
+	}
+	pthread_mutex_unlock(&render_thread->lock);
+	return NULL;
+}
+
+
+int render_thread_start(struct RenderThread *render_thread, char const *canvas_id, void (*setup)(void), void (*draw)(void)) {
+	render_thread->setup = setup;
+	render_thread->draw = draw;
+	render_thread->running = 0;
+	render_thread->started = 0;
+	render_thread->frames = 0;
+	render_thread->quitting = 0;
+	pthread_mutex_init(&render_thread->lock, NULL);
+	pthread_cond_init(&render_thread->changed, NULL);
+	if (pthread_create(&render_thread->thread, NULL, render, render_thread) != 0) {
+		pthread_mutex_destroy(&render_thread->lock);
+		pthread_cond_destroy(&render_thread->changed);
+		return -1;
+	}
+	render_thread->running = 1;
+	pthread_mutex_lock(&render_thread->lock);
+	while (!render_thread->started) {
+		pthread_cond_wait(&render_thread->changed, &render_thread->lock);
+	}
+	pthread_mutex_unlock(&render_thread->lock);
+	return 0;
+}
+
+
+void render_thread_draw(struct RenderThread *render_thread) {
+	pthread_mutex_lock(&render_thread->lock);
+	++render_thread->frames;
+	pthread_cond_broadcast(&render_thread->changed);
+	while (render_thread->frames > 0) {
+		pthread_cond_wait(&render_thread->changed, &render_thread->lock);
+	}
+	pthread_mutex_unlock(&render_thread->lock);
+}
+
+
+void render_thread_stop(struct RenderThread *render_thread) {
+	if (!render_thread->running) {
+		return;
+	}
+	pthread_mutex_lock(&render_thread->lock);
+	render_thread->quitting = 1;
+	pthread_cond_broadcast(&render_thread->changed);
+	pthread_mutex_unlock(&render_thread->lock);
+	pthread_join(render_thread->thread, NULL);
+	pthread_mutex_destroy(&render_thread->lock);
+	pthread_cond_destroy(&render_thread->changed);
+	render_thread->running = 0;
+}
+#elif defined(__EMSCRIPTEN_PTHREADS__)
+// Sets up, then draws to the canvas handed to the thread for as long as the
+// page is open.
+static void *render(void *argument) {
+	struct RenderThread *render_thread = argument;
+	render_thread->setup();
+	emscripten_set_main_loop(render_thread->draw, 0, 1);
+	return NULL;
+}
+
+
+int render_thread_start(struct RenderThread *render_thread, char const *canvas_id, void (*setup)(void), void (*draw)(void)) {
+	render_thread->setup = setup;
+	render_thread->draw = draw;
+	render_thread->running = 0;
+	if (!canTransferCanvas(canvas_id)) {
+		return -1;
+	}
+	// The attribute takes a selector, "#" and the id.
+	char selector[64];
+	snprintf(selector, sizeof(selector), "#%s", canvas_id);
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	emscripten_pthread_attr_settransferredcanvases(&attributes, selector);
+	int failed = pthread_create(&render_thread->thread, &attributes, render, render_thread);
+	pthread_attr_destroy(&attributes);
+	if (failed) {
+		return -1;
+	}
+	pthread_detach(render_thread->thread);
+	render_thread->running = 1;
+	return 0;
+}
+#else
+int render_thread_start(struct RenderThread *render_thread, char const *canvas_id, void (*setup)(void), void (*draw)(void)) {
+	render_thread->setup = setup;
+	render_thread->draw = draw;
+	render_thread->running = 0;
+	return -1;
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <pthread.h>  // pthread_t, pthread_mutex_t, pthread_cond_t
+
+// Sets up drawing and draws on a thread of its own, so that neither ever
+// holds up the page. In the browser, the page's canvas is handed to the
+// thread as an OffscreenCanvas, and the thread runs the main loop:
+//
+//     if (render_thread_start(&render_thread, "root", setup, draw) != 0) {
+//         setup();  // draw on this thread instead
+//         emscripten_set_main_loop(draw, 0, 1);
+//     }
+//
+// The window's events then go to the render thread, which registered for
+// them in setup(). The native build stands in for that: its render thread
+// sets up and then draws a frame each time it's asked, dispatching the
+// window events raised on other threads before each, while the caller waits:
+//
+//     render_thread_start(&render_thread, NULL, setup, draw);
+//     render_thread_draw(&render_thread);  // once the frame is drawn,
+//     // the caller may read it, or change the window, until the next call
+//     render_thread_stop(&render_thread);
+struct RenderThread {
+	void (*setup)(void);
+	void (*draw)(void);
+	pthread_t thread;
+	int running;
+#ifdef HEADLESS
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int started;
+	// Frames asked for and not drawn yet.
+	int frames;
+	int quitting;
+#endif
+};
+
+// Starts the thread, handing it the canvas with the given id in the browser,
+// and, natively, waits for setup() to return. Returns 0 if it started, or -1
+// if threads or the browser's canvas transfer aren't available, in which case
+// the calling thread has to set up and draw.
+int render_thread_start(struct RenderThread *render_thread, char const *canvas_id, void (*setup)(void), void (*draw)(void));
+
+#ifdef HEADLESS
+// Has the thread draw one frame and waits for it.
+void render_thread_draw(struct RenderThread *render_thread);
+
+// Waits for the frame being drawn, if any, and stops the thread. Does nothing
+// if it isn't running.
+void render_thread_stop(struct RenderThread *render_thread);
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#include <math.h>  // ceil
+#include <stdlib.h>  // realloc, free, qsort
+#include "samples.h"
+
+
+void samples_init(struct Samples *samples) {
+	samples->values = NULL;
+	samples->count = 0;
+	samples->capacity = 0;
+}
+
+
+void samples_free(struct Samples *samples) {
+	free(samples->values);
+	samples_init(samples);
+}
+
+
+void samples_clear(struct Samples *samples) {
+	samples->count = 0;
+}
+
+
+void samples_add(struct Samples *samples, double value) {
+	if (samples->count == samples->capacity) {
+		samples->capacity = samples->capacity ? samples->capacity * 2 : 256;
+		samples->values = realloc(samples->values, samples->capacity * sizeof(double));
+	}
+	samples->values[samples->count++] = value;
+}
+
+
+static int compare_values(void const *a, void const *b) {
+	double difference = *(double const *)a - *(double const *)b;
+	return (difference > 0) - (difference < 0);
+}
+
+
+double samples_percentile(struct Samples *samples, double percentile) {
+	if (samples->count == 0) {
+		return 0;
+	}
+	qsort(samples->values, samples->count, sizeof(double), compare_values);
+	int rank = (int)ceil(percentile / 100 * samples->count);
+	if (rank < 1) {
+		rank = 1;
+	}
+	return samples->values[(rank < samples->count ? rank : samples->count) - 1];
+}
+
+
+double samples_mean(struct Samples const *samples) {
+	double total = 0;
+	for (int i = 0; i < samples->count; ++i) {
+		total += samples->values[i];
+	}
+	return samples->count ? total / samples->count : 0;
+}
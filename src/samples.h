@@ -0,0 +1,26 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+// A growable list of measurements, for summarizing with percentiles.
+struct Samples {
+	double *values;
+	int count;
+	int capacity;
+};
+
+void samples_init(struct Samples *samples);
+
+void samples_free(struct Samples *samples);
+
+// Forgets every measurement but keeps the memory for the next batch.
+void samples_clear(struct Samples *samples);
+
+void samples_add(struct Samples *samples, double value);
+
+// Returns the nearest-rank percentile of the measurements, for `percentile`
+// in [0, 100], or 0 if there are none. Sorts the values in place.
+double samples_percentile(struct Samples *samples, double percentile);
+
+double samples_mean(struct Samples const *samples);
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// A thin layer over each instruction set, just wide enough for the particle
+// kernels. Every vector holds LANES coords (see particles.h), so the lane
+// count depends on both the instruction set and PARTICLES_FLOAT. LANES is 1
+// and none of the operations are defined when no instruction set is
+// available; kernels keep a scalar loop for that case and for their tails.
+//
+// SELECT(mask, a, b) takes a where mask is set and b elsewhere. ANDNOT(a, b)
+// is a & ~b. MASK(m) packs the top bit of each lane of m into an int, lane 0
+// in bit 0.
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__wasm_simd128__) && defined(PARTICLES_FLOAT)
+#define LANES 4
+typedef v128_t vector;
+#define LOAD(p) wasm_v128_load(p)
+#define STORE(p, v) wasm_v128_store(p, v)
+#define SPLAT(s) wasm_f32x4_splat(s)
+#define ADD(a, b) wasm_f32x4_add(a, b)
+#define SUB(a, b) wasm_f32x4_sub(a, b)
+#define MUL(a, b) wasm_f32x4_mul(a, b)
+#define LT(a, b) wasm_f32x4_lt(a, b)
+#define GT(a, b) wasm_f32x4_gt(a, b)
+#define NEG(a) wasm_f32x4_neg(a)
+#define OR(a, b) wasm_v128_or(a, b)
+#define ANDNOT(a, b) wasm_v128_andnot(a, b)
+#define SELECT(mask, a, b) wasm_v128_bitselect(a, b, mask)
+#define MASK(m) wasm_i32x4_bitmask(m)
+#elif defined(__wasm_simd128__)
+#define LANES 2
+typedef v128_t vector;
+#define LOAD(p) wasm_v128_load(p)
+#define STORE(p, v) wasm_v128_store(p, v)
+#define SPLAT(s) wasm_f64x2_splat(s)
+#define ADD(a, b) wasm_f64x2_add(a, b)
+#define SUB(a, b) wasm_f64x2_sub(a, b)
+#define MUL(a, b) wasm_f64x2_mul(a, b)
+#define LT(a, b) wasm_f64x2_lt(a, b)
+#define GT(a, b) wasm_f64x2_gt(a, b)
+#define NEG(a) wasm_f64x2_neg(a)
+#define OR(a, b) wasm_v128_or(a, b)
+#define ANDNOT(a, b) wasm_v128_andnot(a, b)
+#define SELECT(mask, a, b) wasm_v128_bitselect(a, b, mask)
+#define MASK(m) wasm_i64x2_bitmask(m)
+#elif defined(__AVX__) && defined(PARTICLES_FLOAT)
+#define LANES 8
+typedef __m256 vector;
+#define LOAD(p) _mm256_loadu_ps(p)
+#define STORE(p, v) _mm256_storeu_ps(p, v)
+#define SPLAT(s) _mm256_set1_ps(s)
+#define ADD(a, b) _mm256_add_ps(a, b)
+#define SUB(a, b) _mm256_sub_ps(a, b)
+#define MUL(a, b) _mm256_mul_ps(a, b)
+#define LT(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define NEG(a) _mm256_xor_ps(a, _mm256_set1_ps(-0.0f))
+#define OR(a, b) _mm256_or_ps(a, b)
+#define ANDNOT(a, b) _mm256_andnot_ps(b, a)
+#define SELECT(mask, a, b) _mm256_blendv_ps(b, a, mask)
+#define MASK(m) _mm256_movemask_ps(m)
+#elif defined(__AVX__)
+#define LANES 4
+typedef __m256d vector;
+#define LOAD(p) _mm256_loadu_pd(p)
+#define STORE(p, v) _mm256_storeu_pd(p, v)
+#define SPLAT(s) _mm256_set1_pd(s)
+#define ADD(a, b) _mm256_add_pd(a, b)
+#define SUB(a, b) _mm256_sub_pd(a, b)
+#define MUL(a, b) _mm256_mul_pd(a, b)
+#define LT(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define GT(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define NEG(a) _mm256_xor_pd(a, _mm256_set1_pd(-0.0))
+#define OR(a, b) _mm256_or_pd(a, b)
+#define ANDNOT(a, b) _mm256_andnot_pd(b, a)
+#define SELECT(mask, a, b) _mm256_blendv_pd(b, a, mask)
+#define MASK(m) _mm256_movemask_pd(m)
+#elif defined(__SSE2__) && defined(PARTICLES_FLOAT)
+#define LANES 4
+typedef __m128 vector;
+#define LOAD(p) _mm_loadu_ps(p)
+#define STORE(p, v) _mm_storeu_ps(p, v)
+#define SPLAT(s) _mm_set1_ps(s)
+#define ADD(a, b) _mm_add_ps(a, b)
+#define SUB(a, b) _mm_sub_ps(a, b)
+#define MUL(a, b) _mm_mul_ps(a, b)
+#define LT(a, b) _mm_cmplt_ps(a, b)
+#define GT(a, b) _mm_cmpgt_ps(a, b)
+#define NEG(a) _mm_xor_ps(a, _mm_set1_ps(-0.0f))
+#define OR(a, b) _mm_or_ps(a, b)
+#define ANDNOT(a, b) _mm_andnot_ps(b, a)
+#define SELECT(mask, a, b) _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+#define MASK(m) _mm_movemask_ps(m)
+#elif defined(__SSE2__)
+#define LANES 2
+typedef __m128d vector;
+#define LOAD(p) _mm_loadu_pd(p)
+#define STORE(p, v) _mm_storeu_pd(p, v)
+#define SPLAT(s) _mm_set1_pd(s)
+#define ADD(a, b) _mm_add_pd(a, b)
+#define SUB(a, b) _mm_sub_pd(a, b)
+#define MUL(a, b) _mm_mul_pd(a, b)
+#define LT(a, b) _mm_cmplt_pd(a, b)
+#define GT(a, b) _mm_cmpgt_pd(a, b)
+#define NEG(a) _mm_xor_pd(a, _mm_set1_pd(-0.0))
+#define OR(a, b) _mm_or_pd(a, b)
+#define ANDNOT(a, b) _mm_andnot_pd(b, a)
+#define SELECT(mask, a, b) _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b))
+#define MASK(m) _mm_movemask_pd(m)
+#else
+#define LANES 1
+#endif
+
+#endif
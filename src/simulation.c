@@ -0,0 +1,251 @@
+#include <math.h>  // ceil, fabs, floor
+#include <limits.h>  // INT_MAX
+#include <stdlib.h>  // realloc, free
+#include <string.h>  // memcpy
+#include <time.h>  // nanosleep
+#include "platform.h"  // performanceNow
+#include "simulation.h"
+
+// Set in Simulation.ready when the snapshot it names hasn't been taken yet.
+#define SNAPSHOT_FRESH 4
+// The most steps the simulator may be asked to catch up on at once.
+#define SIMULATION_MAX_BEHIND 8
+
+// The browser build only has threads when it's compiled with -pthread.
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define HAVE_THREADS 0
+#else
+#define HAVE_THREADS 1
+#endif
+
+
+void simulation_init(struct Simulation *simulation, struct Particles *particles, double threshold, double margin) {
+	simulation->particles = particles;
+	simulation->threshold = threshold;
+	simulation->margin = margin;
+	grid_init(&simulation->grid, threshold);
+	arenaInit(&simulation->step_arena, 0);
+	for (int s = 0; s < 3; ++s) {
+		struct Snapshot *snapshot = &simulation->snapshots[s];
+		snapshot->step = 0;
+		snapshot->count = 0;
+		snapshot->x = NULL;
+		snapshot->y = NULL;
+		snapshot->previous_x = NULL;
+		snapshot->previous_y = NULL;
+		snapshot->capacity = 0;
+		pairs_init(&snapshot->pairs);
+		snapshot->pair_search_time = 0;
+		snapshot->simulation_time = 0;
+	}
+	simulation->front = 0;
+	simulation->back = 1;
+	atomic_init(&simulation->ready, 2);
+	atomic_init(&simulation->width, 0);
+	atomic_init(&simulation->height, 0);
+	atomic_init(&simulation->target, 0);
+	atomic_init(&simulation->active, INT_MAX);
+	atomic_init(&simulation->requested, 0);
+	atomic_init(&simulation->running, 0);
+	simulation->threaded = 0;
+	simulation->step_interval = 1000.0 / 60;
+	simulation->clock_start = 0;
+	simulation->clock_started = 0;
+	simulation->steps = 1;
+	simulation->published = 0;
+	simulation->step_delay = 0;
+	simulation->pool = NULL;
+}
+
+
+void simulation_free(struct Simulation *simulation) {
+	simulation_stop(simulation);
+	arenaFree(&simulation->step_arena);
+	for (int s = 0; s < 3; ++s) {
+		free(simulation->snapshots[s].x);
+		free(simulation->snapshots[s].y);
+		free(simulation->snapshots[s].previous_x);
+		free(simulation->snapshots[s].previous_y);
+		pairs_free(&simulation->snapshots[s].pairs);
+	}
+}
+
+
+// Moves the particles on to step target, then finds the pairs at their new
+// positions and publishes them, with the positions at target and the step
+// before.
+static void step(struct Simulation *simulation, unsigned long target) {
+	struct Particles *particles = simulation->particles;
+	struct Snapshot *snapshot = &simulation->snapshots[simulation->back];
+	int width = atomic_load(&simulation->width);
+	int height = atomic_load(&simulation->height);
+	int active = atomic_load(&simulation->active);
+	active = active < particles->count ? active : particles->count;
+	if (particles->count > snapshot->capacity) {
+		snapshot->capacity = particles->count;
+		snapshot->x = realloc(snapshot->x, snapshot->capacity * sizeof(coord));
+		snapshot->y = realloc(snapshot->y, snapshot->capacity * sizeof(coord));
+		snapshot->previous_x = realloc(snapshot->previous_x, snapshot->capacity * sizeof(coord));
+		snapshot->previous_y = realloc(snapshot->previous_y, snapshot->capacity * sizeof(coord));
+	}
+
+	double start = performanceNow();
+	if (simulation->steps >= target) {
+		memcpy(snapshot->previous_x, particles->x, particles->count * sizeof(coord));
+		memcpy(snapshot->previous_y, particles->y, particles->count * sizeof(coord));
+	}
+	for (; simulation->steps < target; ++simulation->steps) {
+		if (simulation->steps + 1 == target) {
+			memcpy(snapshot->previous_x, particles->x, particles->count * sizeof(coord));
+			memcpy(snapshot->previous_y, particles->y, particles->count * sizeof(coord));
+		}
+		particles_integrate(particles, width, height, simulation->margin);
+	}
+	snapshot->simulation_time = performanceNow() - start;
+
+	start = performanceNow();
+	arenaReset(&simulation->step_arena);
+	grid_begin(&simulation->grid, &simulation->step_arena, width, height, active);
+	for (int i = 0; i < active; ++i) {
+		grid_place(&simulation->grid, i, particles->x[i], particles->y[i]);
+	}
+	grid_end(&simulation->grid);
+	snapshot->pairs.pool = simulation->pool;
+	pairs_find(&snapshot->pairs, particles, &simulation->grid, simulation->threshold);
+	snapshot->count = active;
+	memcpy(snapshot->x, particles->x, active * sizeof(coord));
+	memcpy(snapshot->y, particles->y, active * sizeof(coord));
+	snapshot->step = simulation->published = simulation->steps;
+	snapshot->pair_search_time = performanceNow() - start;
+
+	// Swap the finished snapshot for the one in the middle. The release half
+	// makes its contents visible to the renderer before the index is.
+	simulation->back = atomic_exchange_explicit(&simulation->ready, simulation->back | SNAPSHOT_FRESH, memory_order_acq_rel) & 3;
+
+	if (simulation->step_delay > 0) {
+		struct timespec delay = {simulation->step_delay / 1000, (simulation->step_delay % 1000) * 1000000L};
+		nanosleep(&delay, NULL);
+	}
+}
+
+
+// Steps up to the requested step, if it hasn't been published yet.
+static void catch_up(struct Simulation *simulation) {
+	unsigned long target = atomic_load(&simulation->target);
+	if (target > simulation->published) {
+		step(simulation, target);
+	}
+}
+
+
+#if HAVE_THREADS
+static void *run(void *argument) {
+	struct Simulation *simulation = argument;
+	for (;;) {
+		sem_wait(&simulation->wake);
+		if (!atomic_load(&simulation->running)) {
+			return NULL;
+		}
+		// Cleared before stepping, so a request made during the step gets a
+		// step of its own.
+		atomic_store(&simulation->requested, 0);
+		catch_up(simulation);
+	}
+}
+#endif
+
+
+int simulation_start(struct Simulation *simulation) {
+#if HAVE_THREADS
+	if (simulation->threaded) {
+		return 0;
+	}
+	sem_init(&simulation->wake, 0, 0);
+	atomic_store(&simulation->running, 1);
+	if (pthread_create(&simulation->thread, NULL, run, simulation) != 0) {
+		atomic_store(&simulation->running, 0);
+		sem_destroy(&simulation->wake);
+		return -1;
+	}
+	simulation->threaded = 1;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+
+void simulation_stop(struct Simulation *simulation) {
+#if HAVE_THREADS
+	if (!simulation->threaded) {
+		return;
+	}
+	atomic_store(&simulation->running, 0);
+	sem_post(&simulation->wake);
+	pthread_join(simulation->thread, NULL);
+	sem_destroy(&simulation->wake);
+	simulation->threaded = 0;
+#endif
+}
+
+
+// How many steps after step 1 now is. Times within a millionth of a step of
+// one count as at it, so a clock that ticks in whole steps gets whole steps.
+static double steps_since_start(struct Simulation const *simulation, double now) {
+	double steps = (now - simulation->clock_start) / simulation->step_interval;
+	double nearest = floor(steps + 0.5);
+	return fabs(steps - nearest) < 1e-6 ? nearest : steps;
+}
+
+
+void simulation_request(struct Simulation *simulation, int width, int height, double now) {
+	if (!simulation->clock_started) {
+		simulation->clock_start = now;
+		simulation->clock_started = 1;
+	}
+	// Never ask for more than SIMULATION_MAX_BEHIND steps past the last one
+	// the renderer has seen; the clock is moved up to drop the rest.
+	unsigned long target = 1 + (unsigned long)ceil(steps_since_start(simulation, now));
+	unsigned long seen = simulation->snapshots[simulation->front].step;
+	if (seen && target > seen + SIMULATION_MAX_BEHIND) {
+		simulation->clock_start += (target - seen - SIMULATION_MAX_BEHIND) * simulation->step_interval;
+		target = seen + SIMULATION_MAX_BEHIND;
+	}
+
+	atomic_store(&simulation->width, width);
+	atomic_store(&simulation->height, height);
+	atomic_store(&simulation->target, target);
+#if HAVE_THREADS
+	if (simulation->threaded) {
+		if (!atomic_exchange(&simulation->requested, 1)) {
+			sem_post(&simulation->wake);
+		}
+		return;
+	}
+#endif
+	catch_up(simulation);
+}
+
+
+void simulation_set_active(struct Simulation *simulation, int count) {
+	atomic_store(&simulation->active, count);
+}
+
+
+void simulation_delay(struct Simulation *simulation, double milliseconds) {
+	simulation->clock_start += milliseconds;
+}
+
+
+struct Snapshot const *simulation_acquire(struct Simulation *simulation) {
+	if (atomic_load_explicit(&simulation->ready, memory_order_relaxed) & SNAPSHOT_FRESH) {
+		simulation->front = atomic_exchange_explicit(&simulation->ready, simulation->front, memory_order_acq_rel) & 3;
+	}
+	return &simulation->snapshots[simulation->front];
+}
+
+
+double simulation_blend(struct Simulation const *simulation, struct Snapshot const *snapshot, double now) {
+	double blend = steps_since_start(simulation, now) - (snapshot->step - 2.0);
+	return blend < 0 ? 0 : blend > 1 ? 1 : blend;
+}
@@ -0,0 +1,135 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <pthread.h>  // pthread_t
+#include <semaphore.h>  // sem_t
+#include <stdatomic.h>  // atomic_int
+#include "arena.h"  // Arena
+#include "grid.h"  // Grid
+#include "pairs.h"  // Pairs
+#include "particles.h"  // Particles, coord
+#include "pool.h"  // Pool
+
+// Everything one frame needs to draw: the particles' positions and the pairs
+// found between them at those positions, and where the particles were one
+// step earlier, to draw them in between.
+struct Snapshot {
+	// Which step the positions are from, counting the starting positions as
+	// step 1. 0 until a step has been published into this snapshot.
+	unsigned long step;
+	// The active particles: the first count of them. See simulation_set_active().
+	int count;
+	coord *x;
+	coord *y;
+	// The positions at the step before, or the same positions at step 1.
+	coord *previous_x;
+	coord *previous_y;
+	int capacity;
+	struct Pairs pairs;
+	// How long the simulator spent building the grid and finding the pairs,
+	// and integrating the steps up to this one, in milliseconds.
+	double pair_search_time;
+	double simulation_time;
+};
+
+// Steps the particles at a fixed rate, however often frames are drawn, and
+// finds their pairs, either on a thread of its own or, if it isn't started,
+// on the caller's. Each frame asks for the steps that are due by its time;
+// the particles are moved through all of them, and the pairs are found and
+// published into one of three snapshots only at the last. The renderer
+// always has a complete snapshot to read while the simulator writes the
+// next, and neither side ever waits for the other:
+//
+//     simulation_init(&simulation, &particles, config.threshold, config.particle_size);
+//     simulation_start(&simulation);
+//     // every frame:
+//     simulation_request(&simulation, width, height, now);
+//     struct Snapshot const *snapshot = simulation_acquire(&simulation);
+//     double blend = simulation_blend(&simulation, snapshot, now);
+//     // draw each particle blend of the way from previous_x to x
+//
+// The particles belong to the simulator from simulation_start() until
+// simulation_stop(); without a thread they may be changed between steps.
+struct Simulation {
+	struct Particles *particles;
+	double threshold;
+	double margin;
+	struct Grid grid;
+	// Memory for what a step only needs until it's done, such as the grid.
+	Arena step_arena;
+	struct Snapshot snapshots[3];
+	// The simulator writes snapshots[back] and the renderer reads
+	// snapshots[front]. ready holds the third index, with SNAPSHOT_FRESH set
+	// if it was published after the renderer last took one.
+	int back;
+	int front;
+	atomic_int ready;
+	// The area to step the next steps in, the step to step up to, and
+	// whether steps were requested since the simulator last started.
+	atomic_int width;
+	atomic_int height;
+	atomic_ulong target;
+	// How many particles, from the first, are searched and published.
+	atomic_int active;
+	atomic_int requested;
+	atomic_int running;
+	sem_t wake;
+	pthread_t thread;
+	int threaded;
+	// Milliseconds between steps, 1000 / the rate. Set before the first
+	// request.
+	double step_interval;
+	// When step 1 was requested, and whether it has been. Touched only by the
+	// thread that makes requests.
+	double clock_start;
+	int clock_started;
+	// The step the particles are at, and the last one published. Touched
+	// only by whichever thread is stepping.
+	unsigned long steps;
+	unsigned long published;
+	// Milliseconds every publish sleeps for, to stand in for a slow
+	// simulator.
+	int step_delay;
+	// If set, every pair search is split across the pool's threads.
+	struct Pool *pool;
+};
+
+void simulation_init(struct Simulation *simulation, struct Particles *particles, double threshold, double margin);
+
+void simulation_free(struct Simulation *simulation);
+
+// Moves stepping onto a thread of its own. Returns 0 if it did, or -1 if
+// threads aren't available, in which case simulation_request() keeps
+// stepping on the calling thread.
+int simulation_start(struct Simulation *simulation);
+
+// Waits for the current step to finish and stops the thread.
+void simulation_stop(struct Simulation *simulation);
+
+// Asks for the steps up to the first one at or after now, a performanceNow()
+// timestamp, in a width x height area, so that now falls between the last
+// two. Step 1 is at the time of the first request. Returns at once when there is a thread, which catches up on
+// all the steps requested while it was busy at once; otherwise takes the
+// steps before returning. If the simulator falls more than
+// SIMULATION_MAX_BEHIND steps behind, after a stall or a hidden tab, the
+// steps it missed are dropped rather than run all at once.
+void simulation_request(struct Simulation *simulation, int width, int height, double now);
+
+// Searches for the pairs of, and publishes, only the first count particles
+// from the next step on, or all of them if count is larger than that. The
+// rest keep moving, so they come back where they would have been.
+void simulation_set_active(struct Simulation *simulation, int count);
+
+// Moves every step not yet asked for milliseconds later, as if time had
+// stopped for that long, so the particles pick up where they were.
+void simulation_delay(struct Simulation *simulation, double milliseconds);
+
+// Returns the most recently published snapshot without waiting. It stays
+// valid, and unchanged, until the next call.
+struct Snapshot const *simulation_acquire(struct Simulation *simulation);
+
+// How far from snapshot->previous_x to snapshot->x the particles are at now,
+// from 0 to 1. It's 1 once the simulator is behind.
+double simulation_blend(struct Simulation const *simulation, struct Snapshot const *snapshot, double now);
+
+#endif
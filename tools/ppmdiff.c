@@ -0,0 +1,75 @@
+// Compares two binary PPM images of the same size, such as two frames dumped
+// by the native build, and reports how far apart they are:
+//
+//     ppmdiff [-t tolerance] [-p percent] a.ppm b.ppm
+//
+// A pixel differs if any of its channels is more than `tolerance` (default 8)
+// levels apart. Exits with 1 if more than `percent` (default 1) percent of the
+// pixels differ, and with 2 if the images can't be compared at all.
+#include <stdio.h>  // fopen, fscanf, fread, printf
+#include <stdlib.h>  // malloc, abs, atoi, atof
+#include <unistd.h>  // getopt
+
+
+unsigned char *read_ppm(char const *path, int *width, int *height) {
+	FILE *file = fopen(path, "rb");
+	int max;
+	if (!file || fscanf(file, "P6 %d %d %d", width, height, &max) != 3 || max != 255 || fgetc(file) == EOF) {
+		fprintf(stderr, "%s is not a binary PPM\n", path);
+		exit(2);
+	}
+	size_t size = (size_t)*width * *height * 3;
+	unsigned char *pixels = malloc(size);
+	if (fread(pixels, 1, size, file) != size) {
+		fprintf(stderr, "%s is truncated\n", path);
+		exit(2);
+	}
+	fclose(file);
+	return pixels;
+}
+
+
+int main(int argc, char **argv) {
+	int tolerance = 8;
+	double percent = 1;
+	int option;
+	while ((option = getopt(argc, argv, "t:p:")) != -1) {
+		switch (option) {
+		case 't': tolerance = atoi(optarg); break;
+		case 'p': percent = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-t tolerance] [-p percent] a.ppm b.ppm\n", argv[0]);
+			return 2;
+		}
+	}
+	if (argc - optind != 2) {
+		fprintf(stderr, "usage: %s [-t tolerance] [-p percent] a.ppm b.ppm\n", argv[0]);
+		return 2;
+	}
+
+	int width, height, other_width, other_height;
+	unsigned char *a = read_ppm(argv[optind], &width, &height);
+	unsigned char *b = read_ppm(argv[optind + 1], &other_width, &other_height);
+	if (width != other_width || height != other_height) {
+		fprintf(stderr, "The images are %dx%d and %dx%d\n", width, height, other_width, other_height);
+		return 2;
+	}
+
+	long differing = 0;
+	int largest = 0;
+	double total = 0;
+	for (long pixel = 0; pixel < (long)width * height; ++pixel) {
+		int worst = 0;
+		for (int channel = 0; channel < 3; ++channel) {
+			int difference = abs(a[pixel * 3 + channel] - b[pixel * 3 + channel]);
+			total += difference;
+			worst = difference > worst ? difference : worst;
+		}
+		largest = worst > largest ? worst : largest;
+		differing += worst > tolerance;
+	}
+	double differing_percent = 100.0 * differing / ((double)width * height);
+	printf("%ld pixels (%.3f%%) differ by more than %d; largest difference %d; mean %.4f\n",
+		differing, differing_percent, tolerance, largest, total / ((double)width * height * 3));
+	return differing_percent > percent;
+}